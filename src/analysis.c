@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "analysis.h"
+#include "util.h"
+
+struct analysis
+{
+    search_context *search;
+    int lines;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_bool stop; // Ends the running search, the worker then looks for a new position
+
+    // Guarded by lock
+    game pending; // Next position to search
+    bool has_pending;
+    bool quit;
+    bool active;         // Between analysis_set_position and analysis_stop
+    uint64_t generation; // Counts positions, results of an older one are dropped
+    analysis_info info;
+    double started;      // When analysis became active
+    double busy_seconds; // Searching since then, without the running search
+    double search_start; // Of the running search, 0 while waiting
+
+    game position; // The worker's copy, only touched by the worker
+};
+
+// What a search reports its iterations for
+typedef struct
+{
+    analysis *analysis;
+    uint64_t generation;
+} iteration_target;
+
+static void *analysis_worker(void *arg);
+static void store_iteration(const search_result *result, void *user_data);
+
+analysis *analysis_create(size_t hash_megabytes, int lines)
+{
+    analysis *analysis = calloc(1, sizeof(struct analysis));
+    if (analysis == NULL)
+    {
+        return NULL;
+    }
+
+    analysis->search = search_create(hash_megabytes);
+    if (analysis->search == NULL)
+    {
+        free(analysis);
+        return NULL;
+    }
+
+    analysis->lines = lines;
+    pthread_mutex_init(&analysis->lock, NULL);
+    pthread_cond_init(&analysis->wake, NULL);
+    atomic_init(&analysis->stop, false);
+
+    if (pthread_create(&analysis->thread, NULL, analysis_worker, analysis) != 0)
+    {
+        pthread_cond_destroy(&analysis->wake);
+        pthread_mutex_destroy(&analysis->lock);
+        search_destroy(analysis->search);
+        free(analysis);
+        return NULL;
+    }
+
+    return analysis;
+}
+
+void analysis_destroy(analysis *analysis)
+{
+    if (analysis == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&analysis->lock);
+    analysis->quit = true;
+    atomic_store(&analysis->stop, true);
+    pthread_cond_signal(&analysis->wake);
+    pthread_mutex_unlock(&analysis->lock);
+    pthread_join(analysis->thread, NULL);
+
+    pthread_cond_destroy(&analysis->wake);
+    pthread_mutex_destroy(&analysis->lock);
+    search_destroy(analysis->search);
+    free(analysis);
+}
+
+void analysis_set_position(analysis *analysis, const game *position)
+{
+    pthread_mutex_lock(&analysis->lock);
+    if (!analysis->active)
+    {
+        analysis->active = true;
+        analysis->started = now_seconds();
+        analysis->busy_seconds = 0;
+    }
+
+    analysis->pending = *position;
+    analysis->has_pending = true;
+    analysis->generation++;
+    analysis->info.searching = true;
+    analysis->info.has_result = false;
+    analysis->info.hash = position->hash;
+
+    atomic_store(&analysis->stop, true);
+    pthread_cond_signal(&analysis->wake);
+    pthread_mutex_unlock(&analysis->lock);
+}
+
+void analysis_stop(analysis *analysis)
+{
+    pthread_mutex_lock(&analysis->lock);
+    analysis->active = false;
+    analysis->has_pending = false;
+    analysis->generation++;
+    analysis->info.searching = false;
+    analysis->info.has_result = false;
+    atomic_store(&analysis->stop, true);
+    pthread_mutex_unlock(&analysis->lock);
+}
+
+bool analysis_poll(analysis *analysis, analysis_info *info)
+{
+    if (pthread_mutex_trylock(&analysis->lock) != 0)
+    {
+        return false;
+    }
+
+    *info = analysis->info;
+    double now = now_seconds();
+    double busy = analysis->busy_seconds + ((analysis->search_start > 0) ? now - analysis->search_start : 0);
+    info->busy = (analysis->active && now > analysis->started) ? busy / (now - analysis->started) : 0;
+
+    pthread_mutex_unlock(&analysis->lock);
+    return true;
+}
+
+static void *analysis_worker(void *arg)
+{
+    analysis *analysis = arg;
+
+    pthread_mutex_lock(&analysis->lock);
+    while (true)
+    {
+        while (!analysis->quit && !analysis->has_pending)
+        {
+            pthread_cond_wait(&analysis->wake, &analysis->lock);
+        }
+        if (analysis->quit)
+        {
+            break;
+        }
+
+        // The stop flag is cleared under the lock, so a position set from here on stops this search again
+        analysis->position = analysis->pending;
+        analysis->has_pending = false;
+        atomic_store(&analysis->stop, false);
+        iteration_target target = {analysis, analysis->generation};
+        analysis->search_start = now_seconds();
+        pthread_mutex_unlock(&analysis->lock);
+
+        search_limits limits = {.multi_pv = analysis->lines, .stop = &analysis->stop};
+        search_run(analysis->search, &analysis->position, &limits, store_iteration, &target);
+
+        pthread_mutex_lock(&analysis->lock);
+        analysis->busy_seconds += now_seconds() - analysis->search_start;
+        analysis->search_start = 0;
+        if (target.generation == analysis->generation)
+        {
+            analysis->info.searching = false;
+        }
+    }
+    pthread_mutex_unlock(&analysis->lock);
+
+    return NULL;
+}
+
+// Runs on the worker between iterations, so the search context can be read here
+static void store_iteration(const search_result *result, void *user_data)
+{
+    iteration_target *target = user_data;
+    analysis *analysis = target->analysis;
+    int hashfull = search_hashfull(analysis->search);
+
+    pthread_mutex_lock(&analysis->lock);
+    if (target->generation == analysis->generation)
+    {
+        analysis->info.result = *result;
+        analysis->info.has_result = true;
+        analysis->info.nps = (result->time > 0) ? (uint64_t)(result->nodes / result->time) : 0;
+        analysis->info.hashfull = hashfull;
+    }
+    pthread_mutex_unlock(&analysis->lock);
+}
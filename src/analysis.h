@@ -0,0 +1,40 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "chess.h"
+#include "search.h"
+
+// Background analysis for the GUI: a worker thread searching the last position it was given without a limit, until it
+// is given another one or stopped. The transposition table is kept between positions, so going back and forth through
+// a game reuses earlier work. None of the functions wait for the search
+
+typedef struct analysis analysis;
+
+typedef struct
+{
+    bool searching;        // False once stopped, or when the search ended by itself because every line is a forced mate
+    bool has_result;       // Whether result holds a completed iteration for the current position
+    uint64_t hash;         // Position the result belongs to
+    search_result result;  // Last completed iteration with all its lines, scores are from the view of the side to move
+    uint64_t nps;          // Of the last completed iteration
+    int hashfull;          // Permille of the transposition table in use
+    double busy;           // Fraction of the time since analysis was started that the worker spent searching
+} analysis_info;
+
+// lines is the number of best moves searched for, see search_limits.multi_pv. NULL if the thread or the transposition
+// table couldn't be created
+analysis *analysis_create(size_t hash_megabytes, int lines);
+
+void analysis_destroy(analysis *analysis);
+
+// Analyses the position from now on, the current search is abandoned. The game is copied
+void analysis_set_position(analysis *analysis, const game *position);
+
+// Abandons the current search, the worker waits for the next position
+void analysis_stop(analysis *analysis);
+
+// Copies the latest state into info. Returns false and leaves info alone if the worker holds the lock at the moment,
+// so the caller keeps showing what it had
+bool analysis_poll(analysis *analysis, analysis_info *info);
+
+#endif
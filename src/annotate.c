@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pgn.h"
+#include "review.h"
+#include "util.h"
+
+// Reviews every game of a PGN file and writes it back out annotated:
+//   cchess-annotate [-t threads] [-depth n] [-nodes n] [-hash mb] <input.pgn|->
+// Inaccuracies, mistakes and blunders get ?!, ? and ?? and a comment with the evaluation before and after the move and
+// the engine's choice, scores in pawns from white's view. The positions of each game are spread over all threads.
+// Games with moves that can't be decoded are written out as they were read, with a comment saying so
+
+#define DEFAULT_DEPTH 8
+#define DEFAULT_HASH_MB 16
+#define MOVETEXT_SIZE (MAX_MOVES * 64)
+
+static void write_game(FILE *out, const pgn_game *pgn, const ply_review *reviews, char *movetext);
+static void write_unannotated(FILE *out, const pgn_game *pgn, const char *movetext);
+static void write_tags(FILE *out, const pgn_game *pgn, bool annotated);
+static void write_tag_value(FILE *out, const char *value);
+
+static const char *result_strings[] = {"*", "1-0", "0-1", "1/2-1/2"};
+
+int main(int argc, char **argv)
+{
+    review_options options = {.depth = DEFAULT_DEPTH, .hash_megabytes = DEFAULT_HASH_MB};
+    int arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg += 2)
+    {
+        if (strcmp(argv[arg], "-t") == 0)
+        {
+            options.threads = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-depth") == 0)
+        {
+            options.depth = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-nodes") == 0)
+        {
+            options.nodes = strtoull(argv[arg + 1], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "-hash") == 0)
+        {
+            options.hash_megabytes = atoi(argv[arg + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (arg != argc - 1 || options.hash_megabytes == 0)
+    {
+        fprintf(stderr, "Usage: %s [-t threads] [-depth n] [-nodes n] [-hash mb] <input.pgn|->\n", argv[0]);
+        return 1;
+    }
+
+    pgn_reader *reader = (strcmp(argv[arg], "-") == 0) ? pgn_open_file(stdin) : pgn_open(argv[arg]);
+    if (reader == NULL)
+    {
+        perror(argv[arg]);
+        return 1;
+    }
+    reader->keep_movetext = true;
+
+    reviewer *reviewer = review_create(&options);
+    pgn_game *pgn = malloc(sizeof(pgn_game));
+    ply_review *reviews = malloc(sizeof(ply_review) * MAX_MOVES);
+    char *movetext = malloc(MOVETEXT_SIZE);
+    if (reviewer == NULL || pgn == NULL || reviews == NULL || movetext == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    unsigned long games = 0, skipped = 0;
+    uint64_t positions = 0;
+    uint graded[2][4] = {{0}}; // By color and grade
+    double start = now_seconds();
+
+    while (pgn_next_game(reader, pgn))
+    {
+        if (pgn->error)
+        {
+            write_unannotated(stdout, pgn, reader->movetext);
+            skipped++;
+            continue;
+        }
+
+        review_start(reviewer, &pgn->position);
+        review_wait(reviewer);
+
+        // Nothing else uses the reviewer, so the lock is free
+        uint done;
+        review_poll(reviewer, reviews, &done);
+
+        write_game(stdout, pgn, reviews, movetext);
+        games++;
+        positions += pgn->position.move_history.count + 1;
+
+        // The side that made the first move depends on the start position, the turn changed with every move since
+        uint plies = pgn->position.move_history.count;
+        uint first_mover = (pgn->position.current_turn + plies) % 2;
+        for (uint i = 0; i < done; i++)
+        {
+            graded[(first_mover + i) % 2][reviews[i].grade]++;
+        }
+    }
+
+    double elapsed = now_seconds() - start;
+    fprintf(stderr, "%lu games annotated, %lu skipped, %llu positions in %.1f s (%.0f positions/s)\n", games, skipped,
+            (unsigned long long)positions, elapsed, elapsed > 0 ? positions / elapsed : 0);
+    fprintf(stderr, "White: %u inaccuracies, %u mistakes, %u blunders\n", graded[CChessWhite][ReviewInaccuracy],
+            graded[CChessWhite][ReviewMistake], graded[CChessWhite][ReviewBlunder]);
+    fprintf(stderr, "Black: %u inaccuracies, %u mistakes, %u blunders\n", graded[CChessBlack][ReviewInaccuracy],
+            graded[CChessBlack][ReviewMistake], graded[CChessBlack][ReviewBlunder]);
+
+    review_destroy(reviewer);
+    pgn_close(reader);
+    free(pgn);
+    free(reviews);
+    free(movetext);
+    return 0;
+}
+
+static void write_game(FILE *out, const pgn_game *pgn, const ply_review *reviews, char *movetext)
+{
+    write_tags(out, pgn, true);
+
+    // The moves are replayed from the start position for their SAN
+    game *position = malloc(sizeof(game));
+    if (position == NULL)
+    {
+        return;
+    }
+    *position = pgn->position;
+    while (position->move_history.count > 0)
+    {
+        undo_last_move(position);
+    }
+
+    size_t length = 0;
+    movetext[0] = '\0';
+    for (uint i = 0; i < pgn->position.move_history.count && length + 128 < MOVETEXT_SIZE; i++)
+    {
+        const ply_review *review = &reviews[i];
+        bool white = position->current_turn == CChessWhite;
+        char san[16];
+        move_to_SAN(position, review->played, san);
+
+        if (white)
+        {
+            length += sprintf(movetext + length, "%u. ", position->fullmove_number);
+        }
+        else if (i == 0)
+        {
+            length += sprintf(movetext + length, "%u... ", position->fullmove_number);
+        }
+        length += sprintf(movetext + length, "%s%s ", san, review_grade_suffix(review->grade));
+
+        if (review->grade != ReviewGood)
+        {
+            char best[16], before[16], after[16];
+            move_to_SAN(position, review->best, best);
+            // Scores from white's view
+            review_format_score(white ? review->score_before : -review->score_before, before, sizeof(before));
+            review_format_score(white ? review->score_after : -review->score_after, after, sizeof(after));
+            length += sprintf(movetext + length, "{%s -> %s, best %s} ", before, after, best);
+        }
+
+        make_move(position, review->played);
+    }
+    free(position);
+
+    // Movetext wrapped at 80 columns as the PGN export format asks for
+    int column = 0;
+    const char *p = movetext;
+    const char *result = result_strings[pgn->result];
+    while (true)
+    {
+        while (*p == ' ')
+        {
+            p++;
+        }
+
+        bool at_result = (*p == '\0');
+        const char *token = at_result ? result : p;
+        int token_length = at_result ? (int)strlen(result) : (int)strcspn(p, " ");
+
+        if (column > 0 && column + 1 + token_length > 80)
+        {
+            fputc('\n', out);
+            column = 0;
+        }
+        else if (column > 0)
+        {
+            fputc(' ', out);
+            column++;
+        }
+
+        fwrite(token, 1, token_length, out);
+        column += token_length;
+
+        if (at_result)
+        {
+            break;
+        }
+        p += token_length;
+    }
+
+    fputs("\n\n", out);
+    fflush(out);
+}
+
+// The movetext as it was read, so a database run through the tool doesn't lose games
+static void write_unannotated(FILE *out, const pgn_game *pgn, const char *movetext)
+{
+    write_tags(out, pgn, false);
+
+    size_t length = strlen(movetext);
+    while (length > 0 && (movetext[length - 1] == ' ' || movetext[length - 1] == '\n' || movetext[length - 1] == '\r' ||
+                          movetext[length - 1] == '\t'))
+    {
+        length--;
+    }
+
+    fprintf(out, "{Not annotated, move %u could not be decoded}\n", pgn->error_ply + 1);
+    fwrite(movetext, 1, length, out);
+    fprintf(out, "%s%s\n\n", length > 0 ? " " : "", result_strings[pgn->result]);
+    fflush(out);
+}
+
+// An annotated game gets cchess as its annotator in place of any earlier one
+static void write_tags(FILE *out, const pgn_game *pgn, bool annotated)
+{
+    for (uint i = 0; i < pgn->tag_count; i++)
+    {
+        if (annotated && strcmp(pgn->tags[i].name, "Annotator") == 0)
+        {
+            continue;
+        }
+        fprintf(out, "[%s ", pgn->tags[i].name);
+        write_tag_value(out, pgn->tags[i].value);
+        fprintf(out, "]\n");
+    }
+    if (annotated)
+    {
+        fprintf(out, "[Annotator \"cchess\"]\n");
+    }
+    fputc('\n', out);
+}
+
+static void write_tag_value(FILE *out, const char *value)
+{
+    fputc('"', out);
+    for (const char *c = value; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
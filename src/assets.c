@@ -0,0 +1,15 @@
+#include <string.h>
+#include "assets.h"
+
+// A handful of assets, a linear search is fine
+const embedded_asset *find_asset(const char *name)
+{
+    for (unsigned int i = 0; i < embedded_asset_count; i++)
+    {
+        if (strcmp(embedded_assets[i].name, name) == 0)
+        {
+            return &embedded_assets[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+// Files from assets/ compiled into the GUI, so it starts from any working directory without reading anything. The
+// arrays are generated from the files by src/embed.c when building, see the Makefile
+
+typedef struct
+{
+    const char *name; // Path below assets/, e.g. "highres/white_king.png"
+    const unsigned char *data;
+    unsigned int size;
+} embedded_asset;
+
+extern const embedded_asset embedded_assets[];
+extern const unsigned int embedded_asset_count;
+
+// NULL if no asset has that name
+const embedded_asset *find_asset(const char *name);
+
+#endif
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "chess.h"
+#include "packed.h"
+#include "search.h"
+#include "util.h"
+
+// Streams FEN/EPD positions from a file and runs one operation per position on all cores:
+//   cchess-batch [-t threads] [-q] moves|perft <depth>|search <depth>|fen|pack <file|->
+
+#define LINES_PER_BATCH 1024
+#define MAX_LINE_LENGTH 512
+#define MAX_FEN_LENGTH 128
+#define SEARCH_HASH_MB 4 // Per worker, cleared for every position so results don't depend on the order or thread count
+
+typedef enum
+{
+    OpMoves,
+    OpPerft,
+    OpSearch,
+    OpFen,
+    OpPack
+} batch_op;
+
+typedef struct
+{
+    FILE *input;
+    batch_op op;
+    int depth;
+    bool quiet;
+
+    pthread_mutex_t read_lock;
+    unsigned long next_read_batch;
+
+    // Batches are printed in input order, a worker waits for its turn before writing
+    pthread_mutex_t write_lock;
+    pthread_cond_t write_turn;
+    unsigned long next_write_batch;
+
+    unsigned long positions;
+    unsigned long invalid;
+    uint64_t nodes;
+} batch_context;
+
+static void *batch_worker(void *arg);
+
+int main(int argc, char **argv)
+{
+    batch_context ctx = {0};
+    int threads = cpu_count();
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++)
+    {
+        if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+        {
+            threads = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "-q") == 0)
+        {
+            ctx.quiet = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (arg >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-t threads] [-q] moves|perft <depth>|search <depth>|fen|pack <file|->\n", argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[arg], "moves") == 0)
+    {
+        ctx.op = OpMoves;
+    }
+    else if (strcmp(argv[arg], "perft") == 0 && arg + 1 < argc)
+    {
+        ctx.op = OpPerft;
+        ctx.depth = atoi(argv[++arg]);
+    }
+    else if (strcmp(argv[arg], "search") == 0 && arg + 1 < argc)
+    {
+        ctx.op = OpSearch;
+        ctx.depth = atoi(argv[++arg]);
+        if (ctx.depth < 1)
+        {
+            fprintf(stderr, "Search depth must be at least 1\n");
+            return 1;
+        }
+    }
+    else if (strcmp(argv[arg], "fen") == 0)
+    {
+        ctx.op = OpFen;
+    }
+    else if (strcmp(argv[arg], "pack") == 0)
+    {
+        ctx.op = OpPack;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown operation '%s'\n", argv[arg]);
+        return 1;
+    }
+    arg++;
+
+    if (arg >= argc || strcmp(argv[arg], "-") == 0)
+    {
+        ctx.input = stdin;
+    }
+    else
+    {
+        ctx.input = fopen(argv[arg], "r");
+        if (ctx.input == NULL)
+        {
+            perror(argv[arg]);
+            return 1;
+        }
+    }
+
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+
+    pthread_mutex_init(&ctx.read_lock, NULL);
+    pthread_mutex_init(&ctx.write_lock, NULL);
+    pthread_cond_init(&ctx.write_turn, NULL);
+
+    double start = now_seconds();
+
+    // Workers take batches as they go, so fewer threads than asked for only make it slower
+    pthread_t *workers = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (; workers != NULL && started < threads; started++)
+    {
+        if (pthread_create(&workers[started], NULL, batch_worker, &ctx) != 0)
+        {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    if (started == 0)
+    {
+        fprintf(stderr, "Could not start any threads\n");
+        return 1;
+    }
+    threads = started;
+
+    double elapsed = now_seconds() - start;
+    fflush(stdout);
+    if (elapsed <= 0)
+    {
+        elapsed = 1e-9;
+    }
+
+    fprintf(stderr, "positions: %lu (%lu invalid)\n", ctx.positions, ctx.invalid);
+    if (ctx.op == OpMoves || ctx.op == OpPerft || ctx.op == OpSearch)
+    {
+        const char *label = (ctx.op == OpMoves) ? "legal moves" : (ctx.op == OpPerft) ? "perft nodes" : "search nodes";
+        fprintf(stderr, "%s: %llu\n", label, (unsigned long long)ctx.nodes);
+    }
+    fprintf(stderr, "threads: %d, time: %.3f s\n", threads, elapsed);
+    fprintf(stderr, "throughput: %.0f positions/s", ctx.positions / elapsed);
+    if (ctx.op == OpPerft || ctx.op == OpSearch)
+    {
+        fprintf(stderr, ", %.0f nodes/s", ctx.nodes / elapsed);
+    }
+    fprintf(stderr, "\n");
+
+    if (ctx.input != stdin)
+    {
+        fclose(ctx.input);
+    }
+
+    pthread_mutex_destroy(&ctx.read_lock);
+    pthread_mutex_destroy(&ctx.write_lock);
+    pthread_cond_destroy(&ctx.write_turn);
+
+    return 0;
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_context *ctx = arg;
+
+    // One game per worker, it's too big for the stack of every platform's default thread size
+    game *g = malloc(sizeof(game));
+    char(*lines)[MAX_LINE_LENGTH] = malloc(LINES_PER_BATCH * MAX_LINE_LENGTH);
+    size_t output_capacity = LINES_PER_BATCH * (MAX_FEN_LENGTH + 2);
+    char *output = malloc(output_capacity);
+    // Exiting rather than ending just this worker, the others would wait forever for its batches to be written
+    if (g == NULL || lines == NULL || output == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    search_context *search = (ctx->op == OpSearch) ? search_create(SEARCH_HASH_MB) : NULL;
+    if (ctx->op == OpSearch && search == NULL)
+    {
+        fprintf(stderr, "Could not allocate the transposition table\n");
+        exit(1);
+    }
+
+    while (true)
+    {
+        // Grab the next batch of lines, reading is the only serialised part
+        pthread_mutex_lock(&ctx->read_lock);
+        unsigned long batch = ctx->next_read_batch++;
+        int line_count = 0;
+        while (line_count < LINES_PER_BATCH && fgets(lines[line_count], MAX_LINE_LENGTH, ctx->input) != NULL)
+        {
+            // The rest of a longer line is skipped instead of being read as more positions, the FEN at its start is
+            // still there
+            if (strchr(lines[line_count], '\n') == NULL)
+            {
+                int c;
+                while ((c = fgetc(ctx->input)) != EOF && c != '\n')
+                {
+                }
+            }
+            line_count++;
+        }
+        pthread_mutex_unlock(&ctx->read_lock);
+
+        size_t output_length = 0;
+        unsigned long positions = 0;
+        unsigned long invalid = 0;
+        uint64_t nodes = 0;
+
+        for (int i = 0; i < line_count; i++)
+        {
+            char fen[MAX_FEN_LENGTH];
+            if (!FEN_from_EPD(lines[i], fen, sizeof(fen)))
+            {
+                continue; // Blank line or comment
+            }
+
+            positions++;
+
+            if (!import_FEN(g, fen))
+            {
+                invalid++;
+                output_length += snprintf(output + output_length, output_capacity - output_length, "invalid\n");
+                continue;
+            }
+
+            uint64_t result = 0;
+            switch (ctx->op)
+            {
+            case OpMoves:
+                result = get_all_valid_moves(g).count;
+                break;
+            case OpPerft:
+                result = perft(g, ctx->depth);
+                break;
+            case OpSearch:
+            {
+                // Best move in UCI notation and its score in centipawns from the view of the side to move
+                search_new_game(search);
+                search_limits limits = {.depth = ctx->depth};
+                search_result searched = search_run(search, g, &limits, NULL, NULL);
+                char best[6] = "0000";
+                if (searched.best_move.origin_piece != EMPTY)
+                {
+                    move_to_UCI(searched.best_move, best);
+                }
+                nodes += searched.nodes;
+                output_length += snprintf(output + output_length, output_capacity - output_length, "%s %d\n", best,
+                                          searched.score);
+                continue;
+            }
+            case OpFen:
+                export_FEN(g, output + output_length);
+                output_length += strlen(output + output_length);
+                output[output_length++] = '\n';
+                continue;
+            case OpPack:
+            {
+                packed_position packed;
+                if (!pack_position(g, &packed))
+                {
+                    invalid++;
+                    output_length += snprintf(output + output_length, output_capacity - output_length, "invalid\n");
+                    continue;
+                }
+
+                const uint8_t *bytes = (const uint8_t *)&packed;
+                for (size_t b = 0; b < sizeof(packed); b++)
+                {
+                    output_length += snprintf(output + output_length, output_capacity - output_length, "%02x", bytes[b]);
+                }
+                output[output_length++] = '\n';
+                continue;
+            }
+            }
+
+            nodes += result;
+            output_length += snprintf(output + output_length, output_capacity - output_length, "%llu\n", (unsigned long long)result);
+        }
+
+        pthread_mutex_lock(&ctx->write_lock);
+        while (ctx->next_write_batch != batch)
+        {
+            pthread_cond_wait(&ctx->write_turn, &ctx->write_lock);
+        }
+
+        if (!ctx->quiet)
+        {
+            fwrite(output, 1, output_length, stdout);
+        }
+        ctx->positions += positions;
+        ctx->invalid += invalid;
+        ctx->nodes += nodes;
+        ctx->next_write_batch++;
+
+        pthread_cond_broadcast(&ctx->write_turn);
+        pthread_mutex_unlock(&ctx->write_lock);
+
+        if (line_count < LINES_PER_BATCH)
+        {
+            break; // End of input
+        }
+    }
+
+    search_destroy(search);
+    free(output);
+    free(lines);
+    free(g);
+    return NULL;
+}
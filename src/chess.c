@@ -1,12 +1,50 @@
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "chess.h"
+#include "instrument.h"
 
-static bool has_king_moved(game *game, piece_color color);
-static bool has_rook_moved(game *game, piece_color color, bool kingside);
+#define SQUARE_BIT(x, y) (1ULL << ((y) * 8 + (x)))
+#define MAX_PIECE_MOVES 32 // A queen has at most 27, a pawn that can promote on three squares 12
+
+// Checking pieces and pins against one king, computed once per position so single moves can be tested without make/unmake
+typedef struct
+{
+    uint checker_count;
+    uint64_t check_mask; // Squares a non-king move has to land on (checker and the squares between it and the king)
+    uint64_t pinned;     // Friendly pieces that may only move along the line through the king
+} check_info;
+
+static void init_zobrist();
+static uint64_t en_passant_hash(game *game);
+static void update_castling_rights(game *game, int x, int y);
 static bool is_square_attacked(game *game, int x, int y, piece_color attacker_color);
-static bool is_in_check(game *game, piece_color color);
-static move_list get_pseudo_legal_moves(game *game, int x, int y);
+static bool is_board_square_attacked(piece_type board[8][8], int x, int y, piece_color attacker_color);
+static void add_pseudo_legal_moves(game *game, int x, int y, move *moves, uint *count);
+static void refresh_position_state(game *game);
+static check_info get_check_info(game *game, piece_color color);
+static bool is_legal_move(game *game, const check_info *info, move m);
+static bool has_legal_move(game *game, piece_color color);
+static bool is_insufficient_material(game *game);
+static uint get_piece_moves_to(game *game, piece_type piece, int x, int y, move *out, uint max_moves);
+static piece_type piece_from_char(char c, piece_color color);
+
+// Zobrist keys, filled from a fixed seed so keys stay the same between runs and builds
+static uint64_t zobrist_pieces[13][64];
+static uint64_t zobrist_black_to_move;
+static uint64_t zobrist_castling[16];
+static uint64_t zobrist_en_passant[8];
+
+// Global tables are only written by chess_init, every thread waits until they are complete before reading them
+typedef enum
+{
+    TablesEmpty,
+    TablesFilling,
+    TablesReady
+} table_state;
+
+static atomic_int tables_state = TablesEmpty;
 
 const char *piece_strings[] = {
     "empty",
@@ -26,50 +64,7 @@ const char *piece_strings[] = {
 game init_game()
 {
     game game;
-
-    game.current_turn = CChessWhite;
-    game.status = InProgress;
-    game.move_history = (move_list){.moves = {}, .count = 0};
-
-    // Init board with empty spaces
-    for (int i = 0; i < 8; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            game.board[i][j] = EMPTY;
-        }
-    }
-
-    // Set up Black pieces
-    game.board[0][0] = BlackRook;
-    game.board[0][1] = BlackKnight;
-    game.board[0][2] = BlackBishop;
-    game.board[0][3] = BlackQueen;
-    game.board[0][4] = BlackKing;
-    game.board[0][5] = BlackBishop;
-    game.board[0][6] = BlackKnight;
-    game.board[0][7] = BlackRook;
-
-    for (int j = 0; j < 8; j++) // Black pawns
-    {
-        game.board[1][j] = BlackPawn;
-    }
-
-    // Set up White pieces
-    game.board[7][0] = WhiteRook;
-    game.board[7][1] = WhiteKnight;
-    game.board[7][2] = WhiteBishop;
-    game.board[7][3] = WhiteQueen;
-    game.board[7][4] = WhiteKing;
-    game.board[7][5] = WhiteBishop;
-    game.board[7][6] = WhiteKnight;
-    game.board[7][7] = WhiteRook;
-
-    for (int j = 0; j < 8; j++) // White pawns
-    {
-        game.board[6][j] = WhitePawn;
-    }
-
+    reset_game(&game);
     return game;
 }
 
@@ -78,6 +73,10 @@ void reset_game(game *game)
     game->current_turn = CChessWhite;
     game->status = InProgress;
     game->move_history = (move_list){.moves = {}, .count = 0};
+    game->castling_rights = CastleWhiteKingside | CastleWhiteQueenside | CastleBlackKingside | CastleBlackQueenside;
+    game->en_passant_x = -1;
+    game->halfmove_clock = 0;
+    game->fullmove_number = 1;
 
     // Init board with empty spaces
     for (int i = 0; i < 8; i++)
@@ -117,6 +116,8 @@ void reset_game(game *game)
     {
         game->board[6][j] = WhitePawn;
     }
+
+    refresh_position_state(game);
 }
 
 bool is_within_bounds(int x, int y)
@@ -131,41 +132,155 @@ bool is_within_bounds(int x, int y)
 
 move_list get_valid_moves(game *game, int x, int y)
 {
-    move_list pseudo_moves = get_pseudo_legal_moves(game, x, y);
-    move_list legal_moves = {.moves = {}, .count = 0};
-    piece_color piece_color = get_piece_color(game->board[y][x]);
+    INSTRUMENT_FUNCTION(InstrumentGetValidMoves);
+    move_list legal_moves;
+    legal_moves.count = 0;
+    add_pseudo_legal_moves(game, x, y, legal_moves.moves, &legal_moves.count);
 
-    for (uint i = 0; i < pseudo_moves.count; i++)
+    if (legal_moves.count == 0)
     {
-        move m = pseudo_moves.moves[i];
+        return legal_moves;
+    }
 
-        piece_type temp_dest = game->board[m.y_to][m.x_to];
-        piece_type temp_orig = game->board[m.y_from][m.x_from];
-        game->board[m.y_to][m.x_to] = temp_orig;
-        game->board[m.y_from][m.x_from] = EMPTY;
+    // Filter in place, legal moves keep their order
+    check_info info = get_check_info(game, get_piece_color(game->board[y][x]));
+    uint pseudo_count = legal_moves.count;
+    legal_moves.count = 0;
 
-        if (!is_in_check(game, piece_color))
+    for (uint i = 0; i < pseudo_count; i++)
+    {
+        if (is_legal_move(game, &info, legal_moves.moves[i]))
         {
-            legal_moves.moves[legal_moves.count++] = m;
+            legal_moves.moves[legal_moves.count++] = legal_moves.moves[i];
         }
-
-        game->board[m.y_from][m.x_from] = temp_orig;
-        game->board[m.y_to][m.x_to] = temp_dest;
     }
 
+    INSTRUMENT_COUNT(InstrumentMovesGenerated, pseudo_count);
+    INSTRUMENT_COUNT(InstrumentMovesRejected, pseudo_count - legal_moves.count);
+
     return legal_moves;
 }
 
-static move_list get_pseudo_legal_moves(game *game, int x, int y)
+move_list get_all_valid_moves(game *game)
+{
+    move_list legal_moves;
+    legal_moves.count = generate_legal_moves(game, legal_moves.moves);
+    return legal_moves;
+}
+
+bool find_legal_move(game *game, int x_from, int y_from, int x_to, int y_to, piece_type promotion_piece, move *out)
+{
+    if (!is_within_bounds(x_from, y_from) || !is_within_bounds(x_to, y_to))
+    {
+        return false;
+    }
+
+    piece_type piece = game->board[y_from][x_from];
+    if (piece == EMPTY || get_piece_color(piece) != game->current_turn)
+    {
+        return false;
+    }
+
+    // Only the one piece's moves, and the pins and checks only once a candidate is found
+    move moves[MAX_PIECE_MOVES];
+    uint count = 0;
+    add_pseudo_legal_moves(game, x_from, y_from, moves, &count);
+    for (uint i = 0; i < count; i++)
+    {
+        if (moves[i].x_to == x_to && moves[i].y_to == y_to && moves[i].promotion_piece == promotion_piece)
+        {
+            check_info info = get_check_info(game, game->current_turn);
+            if (!is_legal_move(game, &info, moves[i]))
+            {
+                return false;
+            }
+            *out = moves[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint generate_legal_moves(game *game, move *out)
+{
+    INSTRUMENT_FUNCTION(InstrumentGenerateLegalMoves);
+    piece_color color = game->current_turn;
+    check_info info = get_check_info(game, color);
+    uint count = 0;
+    uint generated = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            if (game->board[i][j] == EMPTY || get_piece_color(game->board[i][j]) != color)
+            {
+                continue;
+            }
+
+            // Filtered per piece, so out only ever holds legal moves
+            move piece_moves[MAX_PIECE_MOVES];
+            uint piece_count = 0;
+            add_pseudo_legal_moves(game, j, i, piece_moves, &piece_count);
+            generated += piece_count;
+
+            for (uint k = 0; k < piece_count; k++)
+            {
+                if (is_legal_move(game, &info, piece_moves[k]))
+                {
+                    out[count++] = piece_moves[k];
+                }
+            }
+        }
+    }
+
+    INSTRUMENT_COUNT(InstrumentMovesGenerated, generated);
+    INSTRUMENT_COUNT(InstrumentMovesRejected, generated - count);
+
+    return count;
+}
+
+uint64_t perft(game *game, int depth)
+{
+    if (depth <= 0)
+    {
+        return 1;
+    }
+
+    move moves[MAX_POSITION_MOVES];
+    uint count = generate_legal_moves(game, moves);
+
+    // Bulk counting, the leaves don't have to be made
+    if (depth == 1)
+    {
+        return count;
+    }
+
+    uint64_t nodes = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        make_move(game, moves[i]);
+        nodes += perft(game, depth - 1);
+        undo_last_move(game);
+    }
+
+    return nodes;
+}
+
+// Appends to moves at *count instead of returning a list, so callers collecting moves of many pieces don't copy a move_list per piece.
+// One piece never has more than MAX_PIECE_MOVES
+static void add_pseudo_legal_moves(game *game, int x, int y, move *moves, uint *count)
 {
-    move_list m = {.moves = {}, .count = 0};
+    INSTRUMENT_FUNCTION(InstrumentAddPseudoLegalMoves);
+    uint first = *count;
     piece_type moving_piece = game->board[y][x];
     piece_color piece_color = get_piece_color(moving_piece);
 
     // Don't return moves for empty squares
     if (moving_piece == EMPTY)
     {
-        return m;
+        return;
     }
 
     switch (moving_piece)
@@ -179,36 +294,24 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
         // Forward one square
         if (is_within_bounds(x, y + direction) && game->board[y + direction][x] == EMPTY)
         {
-            m.moves[m.count++] = (move){x, y, x, y + direction, EMPTY, EMPTY}; // Get filled in at the bottom anyway, 2x EMPTY to supress compiler warnings
+            moves[(*count)++] = (move){x, y, x, y + direction, EMPTY, EMPTY, EMPTY}; // Get filled in at the bottom anyway, 3x EMPTY to supress compiler warnings
 
             // Initial two-square move
             if (y == start_row && game->board[y + 2 * direction][x] == EMPTY)
             {
-                m.moves[m.count++] = (move){x, y, x, y + 2 * direction, EMPTY, EMPTY};
+                moves[(*count)++] = (move){x, y, x, y + 2 * direction, EMPTY, EMPTY, EMPTY};
             }
         }
 
         // En passant
-        if ((moving_piece == WhitePawn && y == 3) || (moving_piece == BlackPawn && y == 4))
+        if (game->en_passant_x != -1 &&
+            abs(game->en_passant_x - x) == 1 &&
+            ((moving_piece == WhitePawn && y == 3) || (moving_piece == BlackPawn && y == 4)))
         {
-            if (game->move_history.count > 0)
-            {
-                move last = game->move_history.moves[game->move_history.count - 1];
-                piece_type last_piece = last.origin_piece;
-
-                // Check if last move was opponent's pawn moving two squares
-                if ((last_piece == BlackPawn || last_piece == WhitePawn) &&
-                    abs(last.y_to - last.y_from) == 2 &&
-                    last.y_to == y &&
-                    abs(last.x_to - x) == 1)
-                {
-                    // Add en passant capture
-                    m.moves[m.count++] = (move){
-                        x, y,                     // from
-                        last.x_to, y + direction, // to
-                        EMPTY, EMPTY};
-                }
-            }
+            moves[(*count)++] = (move){
+                x, y,                              // from
+                game->en_passant_x, y + direction, // to
+                EMPTY, EMPTY, EMPTY};
         }
 
         // Capture diagonally
@@ -219,7 +322,7 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
                 piece_type target = game->board[y + direction][x + dx];
                 if (target != EMPTY && piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, x + dx, y + direction, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, x + dx, y + direction, EMPTY, EMPTY, EMPTY};
                 }
             }
         }
@@ -240,11 +343,11 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
                 piece_type target = game->board[new_y][new_x];
                 if (target == EMPTY)
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                 }
                 else if (piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                     break;
                 }
                 else
@@ -261,18 +364,18 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
     case WhiteKnight:
     case BlackKnight:
     {
-        int moves[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+        int knight_moves[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
         for (int i = 0; i < 8; i++)
         {
-            int new_x = x + moves[i][0];
-            int new_y = y + moves[i][1];
+            int new_x = x + knight_moves[i][0];
+            int new_y = y + knight_moves[i][1];
 
             if (is_within_bounds(new_x, new_y))
             {
                 piece_type target = game->board[new_y][new_x];
                 if (target == EMPTY || piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                 }
             }
         }
@@ -293,11 +396,11 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
                 piece_type target = game->board[new_y][new_x];
                 if (target == EMPTY)
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                 }
                 else if (piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                     break;
                 }
                 else
@@ -325,11 +428,11 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
                 piece_type target = game->board[new_y][new_x];
                 if (target == EMPTY)
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                 }
                 else if (piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                     break;
                 }
                 else
@@ -359,36 +462,36 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
                 piece_type target = game->board[new_y][new_x];
                 if (target == EMPTY || piece_color != get_piece_color(target))
                 {
-                    m.moves[m.count++] = (move){x, y, new_x, new_y, EMPTY, EMPTY};
+                    moves[(*count)++] = (move){x, y, new_x, new_y, EMPTY, EMPTY, EMPTY};
                 }
             }
         }
 
         // Castling
-        if (!has_king_moved(game, piece_color))
+        uint kingside = (piece_color == CChessWhite) ? CastleWhiteKingside : CastleBlackKingside;
+        uint queenside = (piece_color == CChessWhite) ? CastleWhiteQueenside : CastleBlackQueenside;
+
+        // Kingside castling
+        if ((game->castling_rights & kingside) &&
+            game->board[y][x + 1] == EMPTY &&
+            game->board[y][x + 2] == EMPTY &&
+            !is_in_check(game, piece_color) &&                   // Current position not in check
+            !is_square_attacked(game, x + 1, y, !piece_color) && // Square king passes through
+            !is_square_attacked(game, x + 2, y, !piece_color))   // Final square not attacked
         {
-            // Kingside castling
-            if (!has_rook_moved(game, piece_color, true) &&
-                game->board[y][x + 1] == EMPTY &&
-                game->board[y][x + 2] == EMPTY &&
-                !is_in_check(game, piece_color) &&                   // Current position not in check
-                !is_square_attacked(game, x + 1, y, !piece_color) && // Square king passes through
-                !is_square_attacked(game, x + 2, y, !piece_color))   // Final square not attacked
-            {
-                m.moves[m.count++] = (move){x, y, x + 2, y, EMPTY, EMPTY};
-            }
+            moves[(*count)++] = (move){x, y, x + 2, y, EMPTY, EMPTY, EMPTY};
+        }
 
-            // Queenside castling
-            if (!has_rook_moved(game, piece_color, false) &&
-                game->board[y][x - 1] == EMPTY &&
-                game->board[y][x - 2] == EMPTY &&
-                game->board[y][x - 3] == EMPTY &&
-                !is_in_check(game, piece_color) &&                   // Current position not in check
-                !is_square_attacked(game, x - 1, y, !piece_color) && // Square king passes through
-                !is_square_attacked(game, x - 2, y, !piece_color))   // Final square not attacked
-            {
-                m.moves[m.count++] = (move){x, y, x - 2, y, EMPTY, EMPTY};
-            }
+        // Queenside castling
+        if ((game->castling_rights & queenside) &&
+            game->board[y][x - 1] == EMPTY &&
+            game->board[y][x - 2] == EMPTY &&
+            game->board[y][x - 3] == EMPTY &&
+            !is_in_check(game, piece_color) &&                   // Current position not in check
+            !is_square_attacked(game, x - 1, y, !piece_color) && // Square king passes through
+            !is_square_attacked(game, x - 2, y, !piece_color))   // Final square not attacked
+        {
+            moves[(*count)++] = (move){x, y, x - 2, y, EMPTY, EMPTY, EMPTY};
         }
     }
     break;
@@ -397,13 +500,34 @@ static move_list get_pseudo_legal_moves(game *game, int x, int y)
         break;
     }
 
-    for (uint i = 0; i < m.count; i++)
+    uint pseudo_count = *count;
+    for (uint i = first; i < pseudo_count; i++)
     {
-        m.moves[i].origin_piece = moving_piece;
-        m.moves[i].destination_piece = game->board[m.moves[i].y_to][m.moves[i].x_to];
-    }
+        moves[i].origin_piece = moving_piece;
+        moves[i].destination_piece = game->board[moves[i].y_to][moves[i].x_to];
+        moves[i].promotion_piece = EMPTY;
+
+        // A pawn reaching the last rank becomes one move per promotion choice
+        if ((moving_piece == WhitePawn && moves[i].y_to == 0) || (moving_piece == BlackPawn && moves[i].y_to == 7))
+        {
+            piece_type choices[4] = {WhiteQueen, WhiteRook, WhiteBishop, WhiteKnight};
+            if (moving_piece == BlackPawn)
+            {
+                choices[0] = BlackQueen;
+                choices[1] = BlackRook;
+                choices[2] = BlackBishop;
+                choices[3] = BlackKnight;
+            }
 
-    return m;
+            moves[i].promotion_piece = choices[0];
+            for (int c = 1; c < 4; c++)
+            {
+                move promotion = moves[i];
+                promotion.promotion_piece = choices[c];
+                moves[(*count)++] = promotion;
+            }
+        }
+    }
 }
 
 piece_color get_piece_color(piece_type piece)
@@ -418,27 +542,49 @@ piece_color get_piece_color(piece_type piece)
 
 move_result make_move(game *game, move move)
 {
+    INSTRUMENT_FUNCTION(InstrumentMakeMove);
     if (game->move_history.count >= MAX_MOVES)
     {
         // Could also keep track of start and loop around, but would require checking and rewriting most existing functions. With MAX_MOVES being 1024, it will almost never be reached in a single game
-        game->move_history = (move_list){.moves = {}, .count = 0};
+        game->move_history.count = 0;
     }
 
-    game->move_history.moves[game->move_history.count] = move;
-    game->move_history.count++;
-
     move_result res = None;
 
     piece_type moving_piece = game->board[move.y_from][move.x_from];
+    piece_color moving_color = get_piece_color(moving_piece);
+    bool is_pawn = moving_piece == WhitePawn || moving_piece == BlackPawn;
+
+    // Promotions default to a queen if the caller did not pick a piece
+    if (((moving_piece == WhitePawn && move.y_to == 0) || (moving_piece == BlackPawn && move.y_to == 7)) &&
+        move.promotion_piece == EMPTY)
+    {
+        move.promotion_piece = (moving_piece == WhitePawn) ? WhiteQueen : BlackQueen;
+    }
+
+    game->state_history[game->move_history.count] = (ply_state){
+        .hash = game->hash,
+        .halfmove_clock = game->halfmove_clock,
+        .castling_rights = game->castling_rights,
+        .en_passant_x = game->en_passant_x};
+    game->move_history.moves[game->move_history.count] = move;
+    game->move_history.count++;
+
+    // Take out the keys that depend on the state before the move, they are added back at the end
+    game->hash ^= en_passant_hash(game);
+    game->hash ^= zobrist_castling[game->castling_rights];
 
     // En passant
-    if ((moving_piece == WhitePawn || moving_piece == BlackPawn) &&
+    if (is_pawn &&
         move.x_from != move.x_to &&                         // Diagonal move
         game->board[move.y_to][move.x_to] == EMPTY &&       // Moving to empty square
         ((moving_piece == WhitePawn && move.y_from == 3) || // White pawn on rank 5
          (moving_piece == BlackPawn && move.y_from == 4)))  // Black pawn on rank 4
     {
         // Remove the captured pawn
+        piece_type captured_pawn = game->board[move.y_from][move.x_to];
+        game->material_key -= MATERIAL_KEY_UNIT(captured_pawn);
+        game->hash ^= zobrist_pieces[captured_pawn][move.y_from * 8 + move.x_to];
         game->board[move.y_from][move.x_to] = EMPTY;
 
         res = PieceCaptured;
@@ -446,42 +592,70 @@ move_result make_move(game *game, move move)
 
     // Move piece
     game->board[move.y_from][move.x_from] = EMPTY;
+    game->hash ^= zobrist_pieces[moving_piece][move.y_from * 8 + move.x_from];
 
     piece_type destination_piece = game->board[move.y_to][move.x_to];
     if (destination_piece != EMPTY)
     {
+        game->material_key -= MATERIAL_KEY_UNIT(destination_piece);
+        game->hash ^= zobrist_pieces[destination_piece][move.y_to * 8 + move.x_to];
+        if (destination_piece == WhiteKing || destination_piece == BlackKing)
+        {
+            game->king_x[get_piece_color(destination_piece)] = -1;
+            game->king_y[get_piece_color(destination_piece)] = -1;
+        }
+
         res = PieceCaptured;
     }
 
     game->board[move.y_to][move.x_to] = moving_piece;
 
     // Handle promotion
-    if ((moving_piece == WhitePawn && move.y_to == 0) || (moving_piece == BlackPawn && move.y_to == 7))
+    if (move.promotion_piece != EMPTY)
     {
+        game->board[move.y_to][move.x_to] = move.promotion_piece;
+        game->material_key += MATERIAL_KEY_UNIT(move.promotion_piece) - MATERIAL_KEY_UNIT(moving_piece);
         res = Promotion;
     }
 
+    game->hash ^= zobrist_pieces[game->board[move.y_to][move.x_to]][move.y_to * 8 + move.x_to];
+
+    if (moving_piece == WhiteKing || moving_piece == BlackKing)
+    {
+        game->king_x[moving_color] = move.x_to;
+        game->king_y[moving_color] = move.y_to;
+    }
+
     // Handle castling
     if ((moving_piece == WhiteKing || moving_piece == BlackKing) &&
         abs(move.x_to - move.x_from) == 2)
     {
         int rook_row = (moving_piece == WhiteKing) ? 7 : 0;
-        // Kingside castling
-        if (move.x_to > move.x_from)
-        {
-            game->board[rook_row][7] = EMPTY;
-            game->board[rook_row][5] = (moving_piece == WhiteKing) ? WhiteRook : BlackRook;
-        }
-        // Queenside castling
-        else
-        {
-            game->board[rook_row][0] = EMPTY;
-            game->board[rook_row][3] = (moving_piece == WhiteKing) ? WhiteRook : BlackRook;
-        }
+        piece_type rook = (moving_piece == WhiteKing) ? WhiteRook : BlackRook;
+        int rook_from = (move.x_to > move.x_from) ? 7 : 0; // Kingside or queenside castling
+        int rook_to = (move.x_to > move.x_from) ? 5 : 3;
+
+        game->board[rook_row][rook_from] = EMPTY;
+        game->board[rook_row][rook_to] = rook;
+        game->hash ^= zobrist_pieces[rook][rook_row * 8 + rook_from] ^ zobrist_pieces[rook][rook_row * 8 + rook_to];
 
         res = Castle;
     }
 
+    update_castling_rights(game, move.x_from, move.y_from);
+    update_castling_rights(game, move.x_to, move.y_to);
+
+    if (is_pawn || res == PieceCaptured)
+    {
+        game->halfmove_clock = 0;
+    }
+    else
+    {
+        game->halfmove_clock++;
+    }
+
+    game->en_passant_x = (is_pawn && abs(move.y_to - move.y_from) == 2) ? move.x_from : -1;
+
     // Flip turn
     if (game->current_turn == CChessWhite)
     {
@@ -490,53 +664,105 @@ move_result make_move(game *game, move move)
     else
     {
         game->current_turn = CChessWhite;
+        game->fullmove_number++;
     }
 
+    game->hash ^= zobrist_black_to_move;
+    game->hash ^= zobrist_castling[game->castling_rights];
+    game->hash ^= en_passant_hash(game);
+
     return res;
 }
 
 void undo_last_move(game *game)
 {
+    INSTRUMENT_FUNCTION(InstrumentUndoLastMove);
     if (game->move_history.count <= 0)
     {
         return;
     }
 
     move last_move = game->move_history.moves[game->move_history.count - 1];
+    ply_state last_state = game->state_history[game->move_history.count - 1];
     game->move_history.count--;
 
-    game->board[last_move.y_from][last_move.x_from] = last_move.origin_piece;
+    piece_type moving_piece = last_move.origin_piece;
+    piece_color moving_color = get_piece_color(moving_piece);
+
+    game->board[last_move.y_from][last_move.x_from] = moving_piece;
     game->board[last_move.y_to][last_move.x_to] = last_move.destination_piece;
-    if (game->current_turn == CChessBlack)
+
+    if (last_move.destination_piece != EMPTY)
     {
-        game->current_turn = CChessWhite;
+        game->material_key += MATERIAL_KEY_UNIT(last_move.destination_piece);
+        if (last_move.destination_piece == WhiteKing || last_move.destination_piece == BlackKing)
+        {
+            game->king_x[get_piece_color(last_move.destination_piece)] = last_move.x_to;
+            game->king_y[get_piece_color(last_move.destination_piece)] = last_move.y_to;
+        }
     }
-    else
+
+    if (last_move.promotion_piece != EMPTY)
     {
-        game->current_turn = CChessBlack;
+        game->material_key += MATERIAL_KEY_UNIT(moving_piece) - MATERIAL_KEY_UNIT(last_move.promotion_piece);
     }
-}
 
-game_status check_game_over(game *game)
-{
-    // Check if white has a king. If no, then black won and vice versa
-    bool has_wk = false;
-    bool has_bk = false;
-    for (int i = 0; i < 8; i++)
+    // Put back the pawn taken en passant
+    if ((moving_piece == WhitePawn || moving_piece == BlackPawn) &&
+        last_move.x_from != last_move.x_to &&
+        last_move.destination_piece == EMPTY)
     {
-        for (int j = 0; j < 8; j++)
+        piece_type captured_pawn = (moving_piece == WhitePawn) ? BlackPawn : WhitePawn;
+        game->board[last_move.y_from][last_move.x_to] = captured_pawn;
+        game->material_key += MATERIAL_KEY_UNIT(captured_pawn);
+    }
+
+    if (moving_piece == WhiteKing || moving_piece == BlackKing)
+    {
+        game->king_x[moving_color] = last_move.x_from;
+        game->king_y[moving_color] = last_move.y_from;
+
+        // Put back the castled rook
+        if (abs(last_move.x_to - last_move.x_from) == 2)
         {
-            if (game->board[i][j] == WhiteKing)
+            int rook_row = last_move.y_from;
+            piece_type rook = (moving_piece == WhiteKing) ? WhiteRook : BlackRook;
+            if (last_move.x_to > last_move.x_from)
             {
-                has_wk = true;
+                game->board[rook_row][5] = EMPTY;
+                game->board[rook_row][7] = rook;
             }
-            else if (game->board[i][j] == BlackKing)
+            else
             {
-                has_bk = true;
+                game->board[rook_row][3] = EMPTY;
+                game->board[rook_row][0] = rook;
             }
         }
     }
 
+    game->hash = last_state.hash;
+    game->halfmove_clock = last_state.halfmove_clock;
+    game->castling_rights = last_state.castling_rights;
+    game->en_passant_x = last_state.en_passant_x;
+
+    if (game->current_turn == CChessBlack)
+    {
+        game->current_turn = CChessWhite;
+    }
+    else
+    {
+        game->current_turn = CChessBlack;
+        game->fullmove_number--;
+    }
+}
+
+game_status check_game_over(game *game)
+{
+    INSTRUMENT_FUNCTION(InstrumentCheckGameOver);
+    // Check if white has a king. If no, then black won and vice versa
+    bool has_wk = game->king_x[CChessWhite] != -1;
+    bool has_bk = game->king_x[CChessBlack] != -1;
+
     if (has_wk && !has_bk)
     {
         return WhiteWon;
@@ -548,28 +774,9 @@ game_status check_game_over(game *game)
     }
 
     // Check for checkmate or stalemate
-    bool has_legal_moves = false;
     piece_color current_color = game->current_turn;
 
-    // Try to find at least one legal move
-    for (int i = 0; i < 8 && !has_legal_moves; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            if (game->board[i][j] != EMPTY &&
-                get_piece_color(game->board[i][j]) == current_color)
-            {
-                move_list moves = get_valid_moves(game, j, i);
-                if (moves.count > 0)
-                {
-                    has_legal_moves = true;
-                    break;
-                }
-            }
-        }
-    }
-
-    if (!has_legal_moves)
+    if (!has_legal_move(game, current_color))
     {
         if (is_in_check(game, current_color))
         {
@@ -578,139 +785,569 @@ game_status check_game_over(game *game)
         return Stalemate;
     }
 
+    if (game->halfmove_clock >= 100)
+    {
+        return FiftyMoveRule;
+    }
+
+    if (repetition_count(game) >= 2)
+    {
+        return ThreefoldRepetition;
+    }
+
+    if (is_insufficient_material(game))
+    {
+        return InsufficientMaterial;
+    }
+
     return InProgress;
 }
 
-static bool has_king_moved(game *game, piece_color color)
+uint repetition_count(game *game)
 {
-    piece_type king = (color == CChessWhite) ? WhiteKing : BlackKing;
-    int start_x = 4;
-    int start_y = (color == CChessWhite) ? 7 : 0;
+    INSTRUMENT_FUNCTION(InstrumentRepetitionCount);
+    // Nothing before the last capture or pawn move can repeat, and history from before an import is gone anyway
+    uint plies = game->halfmove_clock;
+    if (plies > game->move_history.count)
+    {
+        plies = game->move_history.count;
+    }
 
-    for (uint i = 0; i < game->move_history.count; i++)
+    // The same side is to move only every second ply
+    uint count = 0;
+    for (uint i = 2; i <= plies; i += 2)
     {
-        move m = game->move_history.moves[i];
-        if (m.origin_piece == king &&
-            m.x_from == start_x &&
-            m.y_from == start_y)
+        if (game->state_history[game->move_history.count - i].hash == game->hash)
         {
-            return true;
+            count++;
         }
     }
-    return false;
+
+    return count;
 }
 
-static bool has_rook_moved(game *game, piece_color color, bool kingside)
+void chess_init()
 {
-    piece_type rook = (color == CChessWhite) ? WhiteRook : BlackRook;
-    int start_x = kingside ? 7 : 0;
-    int start_y = (color == CChessWhite) ? 7 : 0;
+    if (atomic_load_explicit(&tables_state, memory_order_acquire) == TablesReady)
+    {
+        return;
+    }
 
-    for (uint i = 0; i < game->move_history.count; i++)
+    int expected = TablesEmpty;
+    if (atomic_compare_exchange_strong_explicit(&tables_state, &expected, TablesFilling, memory_order_acquire,
+                                                memory_order_acquire))
     {
-        move m = game->move_history.moves[i];
-        if (m.origin_piece == rook &&
-            m.x_from == start_x &&
-            m.y_from == start_y)
-        {
-            return true;
-        }
+        init_zobrist();
+        atomic_store_explicit(&tables_state, TablesReady, memory_order_release);
+        return;
     }
-    return false;
-}
 
-static bool is_square_attacked(game *game, int x, int y, piece_color attacker_color)
-{
-    for (int i = 0; i < 8; i++)
+    // Another thread is filling the tables, which takes microseconds
+    while (atomic_load_explicit(&tables_state, memory_order_acquire) != TablesReady)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            piece_type piece = game->board[i][j];
-            if (piece != EMPTY && get_piece_color(piece) == attacker_color)
-            {
-                move_list moves = get_pseudo_legal_moves(game, j, i);
-                for (uint k = 0; k < moves.count; k++)
-                {
-                    if (moves.moves[k].x_to == x && moves.moves[k].y_to == y)
-                    {
-                        return true;
-                    }
-                }
-            }
-        }
     }
-    return false;
 }
 
-static bool is_in_check(game *game, piece_color color)
+static void init_zobrist()
 {
-    int king_x = -1, king_y = -1;
-    piece_type king = (color == CChessWhite) ? WhiteKing : BlackKing;
+    // splitmix64
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint64_t *tables[] = {&zobrist_pieces[0][0], &zobrist_black_to_move, zobrist_castling, zobrist_en_passant};
+    size_t sizes[] = {13 * 64, 1, 16, 8};
 
-    for (int i = 0; i < 8; i++)
+    for (int t = 0; t < 4; t++)
     {
-        for (int j = 0; j < 8; j++)
+        for (size_t i = 0; i < sizes[t]; i++)
         {
-            if (game->board[i][j] == king)
-            {
-                king_y = i;
-                king_x = j;
-                break;
-            }
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            tables[t][i] = z ^ (z >> 31);
         }
-        if (king_x != -1)
-            break;
     }
 
-    return is_square_attacked(game, king_x, king_y, !color);
+    // Empty squares never change the key
+    for (int i = 0; i < 64; i++)
+    {
+        zobrist_pieces[EMPTY][i] = 0;
+    }
+    zobrist_castling[0] = 0;
+}
+
+static uint64_t en_passant_hash(game *game)
+{
+    // Only hash the en passant file if a capture is actually possible, otherwise identical positions would get different keys
+    return can_capture_en_passant(game) ? zobrist_en_passant[game->en_passant_x] : 0;
 }
 
-bool import_FEN(game *game, const char *fen)
+bool can_capture_en_passant(game *game)
 {
-    printf("Starting FEN import with: %s\n", fen);
+    if (game->en_passant_x == -1)
+    {
+        return false;
+    }
 
-    // Reset the board first
-    for (int i = 0; i < 8; i++)
+    int row = (game->current_turn == CChessWhite) ? 3 : 4;
+    piece_type pawn = (game->current_turn == CChessWhite) ? WhitePawn : BlackPawn;
+    for (int dx = -1; dx <= 1; dx += 2)
     {
-        for (int j = 0; j < 8; j++)
+        if (is_within_bounds(game->en_passant_x + dx, row) && game->board[row][game->en_passant_x + dx] == pawn)
         {
-            game->board[i][j] = EMPTY;
+            return true;
         }
     }
 
-    int rank = 0; // Current rank (0-7)
-    int file = 0; // Current file (0-7)
-    int pos = 0;  // Position in FEN string
-
-    // 1. Parse piece placement
-    while (rank < 8)
+    return false;
+}
+
+static void update_castling_rights(game *game, int x, int y)
+{
+    // Any move from or to a king or rook start square ends the rights that depend on it
+    if (y == 7)
     {
-        char c = fen[pos++];
-        printf("Processing character '%c' at rank %d, file %d\n", c, rank, file);
+        if (x == 4)
+            game->castling_rights &= ~(CastleWhiteKingside | CastleWhiteQueenside);
+        else if (x == 7)
+            game->castling_rights &= ~CastleWhiteKingside;
+        else if (x == 0)
+            game->castling_rights &= ~CastleWhiteQueenside;
+    }
+    else if (y == 0)
+    {
+        if (x == 4)
+            game->castling_rights &= ~(CastleBlackKingside | CastleBlackQueenside);
+        else if (x == 7)
+            game->castling_rights &= ~CastleBlackKingside;
+        else if (x == 0)
+            game->castling_rights &= ~CastleBlackQueenside;
+    }
+}
+
+static bool is_square_attacked(game *game, int x, int y, piece_color attacker_color)
+{
+    INSTRUMENT_FUNCTION(InstrumentIsSquareAttacked);
+    if (!is_within_bounds(x, y))
+    {
+        return false;
+    }
+
+    bool white = attacker_color == CChessWhite;
 
-        if (c == '\0')
+    // Pawns attack towards the opponent, so look one row back from their point of view
+    int pawn_y = white ? y + 1 : y - 1;
+    piece_type pawn = white ? WhitePawn : BlackPawn;
+    for (int dx = -1; dx <= 1; dx += 2)
+    {
+        if (is_within_bounds(x + dx, pawn_y) && game->board[pawn_y][x + dx] == pawn)
         {
-            printf("Error: Unexpected end of string\n");
-            return false;
+            return true;
         }
+    }
 
-        // Break the piece placement loop when we hit the first space
-        if (c == ' ')
+    piece_type knight = white ? WhiteKnight : BlackKnight;
+    int knight_moves[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+    for (int i = 0; i < 8; i++)
+    {
+        int new_x = x + knight_moves[i][0];
+        int new_y = y + knight_moves[i][1];
+        if (is_within_bounds(new_x, new_y) && game->board[new_y][new_x] == knight)
+        {
+            return true;
+        }
+    }
+
+    // Sliders and the king, first four directions are straight (rook), last four diagonal (bishop)
+    piece_type king = white ? WhiteKing : BlackKing;
+    piece_type queen = white ? WhiteQueen : BlackQueen;
+    piece_type rook = white ? WhiteRook : BlackRook;
+    piece_type bishop = white ? WhiteBishop : BlackBishop;
+    int directions[8][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    for (int d = 0; d < 8; d++)
+    {
+        piece_type slider = (d < 4) ? rook : bishop;
+        int dx = directions[d][0], dy = directions[d][1];
+        int new_x = x + dx, new_y = y + dy;
+
+        if (is_within_bounds(new_x, new_y) && game->board[new_y][new_x] == king)
+        {
+            return true;
+        }
+
+        while (is_within_bounds(new_x, new_y))
         {
-            if (rank == 7 && file == 8) // Make sure we completed the board
+            piece_type target = game->board[new_y][new_x];
+            if (target != EMPTY)
             {
-                pos--; // Back up one character since we'll consume the space later
+                if (target == queen || target == slider)
+                {
+                    return true;
+                }
                 break;
             }
-            printf("Error: Incomplete board at rank %d, file %d\n", rank, file);
-            return false;
+            new_x += dx;
+            new_y += dy;
+        }
+    }
+
+    return false;
+}
+
+static bool is_board_square_attacked(piece_type board[8][8], int x, int y, piece_color attacker_color)
+{
+    // is_square_attacked only reads the board of the game
+    game probe;
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            probe.board[i][j] = board[i][j];
+        }
+    }
+
+    return is_square_attacked(&probe, x, y, attacker_color);
+}
+
+bool is_in_check(game *game, piece_color color)
+{
+    INSTRUMENT_FUNCTION(InstrumentIsInCheck);
+    return is_square_attacked(game, game->king_x[color], game->king_y[color], !color);
+}
+
+static void refresh_position_state(game *game)
+{
+    chess_init();
+
+    game->king_x[CChessWhite] = game->king_y[CChessWhite] = -1;
+    game->king_x[CChessBlack] = game->king_y[CChessBlack] = -1;
+    game->material_key = 0;
+    game->hash = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            piece_type piece = game->board[i][j];
+            if (piece == EMPTY)
+            {
+                continue;
+            }
+
+            game->material_key += MATERIAL_KEY_UNIT(piece);
+            game->hash ^= zobrist_pieces[piece][i * 8 + j];
+            if (piece == WhiteKing || piece == BlackKing)
+            {
+                game->king_x[get_piece_color(piece)] = j;
+                game->king_y[get_piece_color(piece)] = i;
+            }
+        }
+    }
+
+    if (game->current_turn == CChessBlack)
+    {
+        game->hash ^= zobrist_black_to_move;
+    }
+    game->hash ^= zobrist_castling[game->castling_rights];
+    game->hash ^= en_passant_hash(game);
+}
+
+static check_info get_check_info(game *game, piece_color color)
+{
+    INSTRUMENT_FUNCTION(InstrumentGetCheckInfo);
+    check_info info = {.checker_count = 0, .check_mask = ~0ULL, .pinned = 0};
+    int king_x = game->king_x[color];
+    int king_y = game->king_y[color];
+
+    if (king_x == -1)
+    {
+        return info;
+    }
+
+    bool white = color == CChessWhite;
+    uint64_t checkers = 0;
+
+    // Enemy pawns and knights can only give check, never pin
+    int pawn_y = white ? king_y - 1 : king_y + 1;
+    piece_type enemy_pawn = white ? BlackPawn : WhitePawn;
+    for (int dx = -1; dx <= 1; dx += 2)
+    {
+        if (is_within_bounds(king_x + dx, pawn_y) && game->board[pawn_y][king_x + dx] == enemy_pawn)
+        {
+            checkers |= SQUARE_BIT(king_x + dx, pawn_y);
+            info.checker_count++;
+        }
+    }
+
+    piece_type enemy_knight = white ? BlackKnight : WhiteKnight;
+    int knight_moves[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+    for (int i = 0; i < 8; i++)
+    {
+        int new_x = king_x + knight_moves[i][0];
+        int new_y = king_y + knight_moves[i][1];
+        if (is_within_bounds(new_x, new_y) && game->board[new_y][new_x] == enemy_knight)
+        {
+            checkers |= SQUARE_BIT(new_x, new_y);
+            info.checker_count++;
+        }
+    }
+
+    // Walk every ray from the king, the first enemy slider seen either checks (nothing in between) or pins (one friendly piece in between)
+    piece_type enemy_queen = white ? BlackQueen : WhiteQueen;
+    int directions[8][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    for (int d = 0; d < 8; d++)
+    {
+        piece_type enemy_slider = (d < 4) ? (white ? BlackRook : WhiteRook) : (white ? BlackBishop : WhiteBishop);
+        int dx = directions[d][0], dy = directions[d][1];
+        int new_x = king_x + dx, new_y = king_y + dy;
+        uint64_t ray = 0;
+        int blocker_x = -1, blocker_y = -1;
+
+        while (is_within_bounds(new_x, new_y))
+        {
+            piece_type target = game->board[new_y][new_x];
+            ray |= SQUARE_BIT(new_x, new_y);
+
+            if (target != EMPTY)
+            {
+                if (get_piece_color(target) == color)
+                {
+                    if (blocker_x != -1)
+                    {
+                        break; // Two friendly pieces, nothing is pinned
+                    }
+                    blocker_x = new_x;
+                    blocker_y = new_y;
+                }
+                else
+                {
+                    if (target == enemy_queen || target == enemy_slider)
+                    {
+                        if (blocker_x == -1)
+                        {
+                            checkers |= ray;
+                            info.checker_count++;
+                        }
+                        else
+                        {
+                            info.pinned |= SQUARE_BIT(blocker_x, blocker_y);
+                        }
+                    }
+                    break;
+                }
+            }
+            new_x += dx;
+            new_y += dy;
+        }
+    }
+
+    if (info.checker_count > 0)
+    {
+        info.check_mask = checkers;
+    }
+
+    return info;
+}
+
+static bool is_legal_move(game *game, const check_info *info, move m)
+{
+    INSTRUMENT_FUNCTION(InstrumentIsLegalMove);
+    piece_type moving_piece = game->board[m.y_from][m.x_from];
+    piece_color color = get_piece_color(moving_piece);
+
+    if (moving_piece == WhiteKing || moving_piece == BlackKing)
+    {
+        // Castling is fully checked when it is generated
+        if (abs(m.x_to - m.x_from) == 2)
+        {
+            return true;
+        }
+
+        // Lift the king so squares behind it along a checking ray count as attacked
+        game->board[m.y_from][m.x_from] = EMPTY;
+        bool attacked = is_square_attacked(game, m.x_to, m.y_to, !color);
+        game->board[m.y_from][m.x_from] = moving_piece;
+        return !attacked;
+    }
+
+    // En passant removes two pieces from the king's surroundings, too rare to be worth a shortcut
+    if ((moving_piece == WhitePawn || moving_piece == BlackPawn) &&
+        m.x_from != m.x_to &&
+        game->board[m.y_to][m.x_to] == EMPTY)
+    {
+        piece_type captured = game->board[m.y_from][m.x_to];
+        game->board[m.y_from][m.x_to] = EMPTY;
+        game->board[m.y_from][m.x_from] = EMPTY;
+        game->board[m.y_to][m.x_to] = moving_piece;
+
+        bool in_check = is_in_check(game, color);
+
+        game->board[m.y_to][m.x_to] = EMPTY;
+        game->board[m.y_from][m.x_from] = moving_piece;
+        game->board[m.y_from][m.x_to] = captured;
+        return !in_check;
+    }
+
+    if (info->checker_count >= 2)
+    {
+        return false;
+    }
+
+    if (!(info->check_mask & SQUARE_BIT(m.x_to, m.y_to)))
+    {
+        return false;
+    }
+
+    if (info->pinned & SQUARE_BIT(m.x_from, m.y_from))
+    {
+        // A pinned piece stays legal as long as it moves along the line through its king
+        int king_x = game->king_x[color];
+        int king_y = game->king_y[color];
+        return (m.x_from - king_x) * (m.y_to - king_y) == (m.y_from - king_y) * (m.x_to - king_x);
+    }
+
+    return true;
+}
+
+static bool has_legal_move(game *game, piece_color color)
+{
+    INSTRUMENT_FUNCTION(InstrumentHasLegalMove);
+    check_info info = get_check_info(game, color);
+    int king_x = game->king_x[color];
+    int king_y = game->king_y[color];
+
+    // King steps first, they are the only moves left in double check. Castling never needs testing, a legal castle implies a legal step towards the rook
+    if (king_x != -1)
+    {
+        int directions[8][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+        for (int d = 0; d < 8; d++)
+        {
+            int new_x = king_x + directions[d][0];
+            int new_y = king_y + directions[d][1];
+            if (!is_within_bounds(new_x, new_y))
+            {
+                continue;
+            }
+
+            piece_type target = game->board[new_y][new_x];
+            if (target != EMPTY && get_piece_color(target) == color)
+            {
+                continue;
+            }
+
+            if (is_legal_move(game, &info, (move){king_x, king_y, new_x, new_y, EMPTY, EMPTY, EMPTY}))
+            {
+                return true;
+            }
+        }
+    }
+
+    if (info.checker_count >= 2)
+    {
+        return false;
+    }
+
+    move moves[MAX_PIECE_MOVES];
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            piece_type piece = game->board[i][j];
+            if (piece == EMPTY || piece == WhiteKing || piece == BlackKing || get_piece_color(piece) != color)
+            {
+                continue;
+            }
+
+            uint count = 0;
+            add_pseudo_legal_moves(game, j, i, moves, &count);
+            for (uint k = 0; k < count; k++)
+            {
+                if (is_legal_move(game, &info, moves[k]))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool is_insufficient_material(game *game)
+{
+    uint64_t key = game->material_key;
+    key -= key & (0xFULL * MATERIAL_KEY_UNIT(WhiteKing));
+    key -= key & (0xFULL * MATERIAL_KEY_UNIT(BlackKing));
+
+    // Bare kings, or a single knight or bishop on the whole board
+    if (key == 0 ||
+        key == MATERIAL_KEY_UNIT(WhiteKnight) || key == MATERIAL_KEY_UNIT(BlackKnight) ||
+        key == MATERIAL_KEY_UNIT(WhiteBishop) || key == MATERIAL_KEY_UNIT(BlackBishop))
+    {
+        return true;
+    }
+
+    // Only bishops left, drawn if they all live on squares of one colour
+    uint64_t bishop_nibbles = 0xFULL * MATERIAL_KEY_UNIT(WhiteBishop) | 0xFULL * MATERIAL_KEY_UNIT(BlackBishop);
+    if ((key & ~bishop_nibbles) != 0)
+    {
+        return false;
+    }
+
+    int square_colors = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            if (game->board[i][j] == WhiteBishop || game->board[i][j] == BlackBishop)
+            {
+                square_colors |= 1 << ((i + j) % 2);
+            }
+        }
+    }
+
+    return square_colors != 3;
+}
+
+bool import_FEN(game *game, const char *fen)
+{
+    INSTRUMENT_FUNCTION(InstrumentImportFEN);
+    // Everything is parsed into locals first, so the game is left untouched if the string turns out to be invalid
+    piece_type board[8][8];
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            board[i][j] = EMPTY;
+        }
+    }
+
+    int rank = 0; // Current rank (0-7)
+    int file = 0; // Current file (0-7)
+    int pos = 0;  // Position in FEN string
+
+    while (fen[pos] == ' ')
+    {
+        pos++;
+    }
+
+    // 1. Parse piece placement
+    while (true)
+    {
+        char c = fen[pos++];
+
+        if (c == ' ')
+        {
+            // Make sure we completed the board
+            if (rank != 7 || file != 8)
+            {
+                return false;
+            }
+            break;
         }
 
         if (c == '/')
         {
-            if (file != 8)
+            if (file != 8 || rank == 7)
             {
-                printf("Error: Incomplete rank %d (file = %d)\n", rank, file);
                 return false;
             }
             rank++;
@@ -718,20 +1355,16 @@ bool import_FEN(game *game, const char *fen)
         }
         else if (c >= '1' && c <= '8')
         {
-            int empty_squares = c - '0';
-            printf("Adding %d empty squares\n", empty_squares);
-            if (file + empty_squares > 8)
+            file += c - '0';
+            if (file > 8)
             {
-                printf("Error: Too many squares in rank %d (file = %d, adding %d)\n", rank, file, empty_squares);
                 return false;
             }
-            file += empty_squares;
         }
         else
         {
             if (file >= 8)
             {
-                printf("Error: Too many squares in rank %d\n", rank);
                 return false;
             }
 
@@ -775,96 +1408,256 @@ bool import_FEN(game *game, const char *fen)
                 piece = BlackKing;
                 break;
             default:
-                printf("Error: Invalid piece character '%c'\n", c);
-                return false;
+                return false; // Invalid character, also catches an unexpected end of string
             }
 
-            printf("Placing piece %s at rank %d, file %d\n", piece_strings[piece], rank, file);
-            game->board[rank][file++] = piece;
+            board[rank][file++] = piece;
         }
     }
 
-    if (fen[pos++] != ' ')
+    // 2. Parse active color
+    piece_color active_color;
+    char color_char = fen[pos++];
+    if (color_char == 'w')
+    {
+        active_color = CChessWhite;
+    }
+    else if (color_char == 'b')
+    {
+        active_color = CChessBlack;
+    }
+    else
     {
-        printf("Error: Expected space after piece placement\n");
         return false;
     }
 
-    // 2. Parse active color
-    char active_color = fen[pos++];
-    printf("Processing active color: %c\n", active_color);
-    if (active_color == 'w')
+    if (fen[pos++] != ' ')
     {
-        game->current_turn = CChessWhite;
+        return false;
     }
-    else if (active_color == 'b')
+
+    // 3. Parse castling availability
+    uint castling_rights = 0;
+    if (fen[pos] == '-')
     {
-        game->current_turn = CChessBlack;
+        pos++;
     }
     else
     {
-        printf("Error: Invalid active color '%c'\n", active_color);
-        return false;
+        while (fen[pos] != ' ' && fen[pos] != '\0')
+        {
+            uint right;
+            switch (fen[pos])
+            {
+            case 'K':
+                right = CastleWhiteKingside;
+                break;
+            case 'Q':
+                right = CastleWhiteQueenside;
+                break;
+            case 'k':
+                right = CastleBlackKingside;
+                break;
+            case 'q':
+                right = CastleBlackQueenside;
+                break;
+            default:
+                return false;
+            }
+
+            if (castling_rights & right)
+            {
+                return false;
+            }
+            castling_rights |= right;
+            pos++;
+        }
+
+        if (castling_rights == 0)
+        {
+            return false;
+        }
     }
 
     if (fen[pos++] != ' ')
     {
-        printf("Error: Expected space after active color\n");
         return false;
     }
 
-    // 3. Skip castling availability (for now)
-    while (fen[pos] != ' ')
+    // 4. Parse en passant target square
+    int en_passant_x = -1;
+    if (fen[pos] == '-')
     {
-        if (fen[pos] == '\0')
+        pos++;
+    }
+    else
+    {
+        // The rank is only read once the file is known not to be the terminator
+        if (fen[pos] < 'a' || fen[pos] > 'h' || fen[pos + 1] != ((active_color == CChessWhite) ? '6' : '3'))
         {
-            printf("Error: Expected space after castling availability\n");
             return false;
         }
-        pos++;
+        en_passant_x = fen[pos] - 'a';
+        pos += 2;
     }
-    pos++; // Skip the space
 
-    // 4. Skip en passant target square (for now)
-    while (fen[pos] != ' ')
+    if (fen[pos] != ' ' && fen[pos] != '\0')
     {
+        return false;
+    }
+
+    // 5. and 6. Halfmove clock and fullmove number, optional since EPD leaves them out
+    uint clocks[2] = {0, 1};
+    for (int i = 0; i < 2; i++)
+    {
+        while (fen[pos] == ' ')
+        {
+            pos++;
+        }
+
         if (fen[pos] == '\0')
         {
-            printf("Error: Expected space after en passant target square\n");
+            break;
+        }
+
+        if (fen[pos] < '0' || fen[pos] > '9')
+        {
+            return false;
+        }
+
+        uint value = 0;
+        while (fen[pos] >= '0' && fen[pos] <= '9')
+        {
+            value = value * 10 + (fen[pos++] - '0');
+            if (value > 100000)
+            {
+                return false;
+            }
+        }
+
+        if (fen[pos] != ' ' && fen[pos] != '\0')
+        {
             return false;
         }
+        clocks[i] = value;
+    }
+
+    while (fen[pos] == ' ' || fen[pos] == '\n' || fen[pos] == '\r' || fen[pos] == '\t')
+    {
         pos++;
     }
-    pos++; // Skip the space
 
-    // 5. Skip halfmove clock (for now)
-    while (fen[pos] != ' ')
+    if (fen[pos] != '\0' || clocks[1] == 0)
     {
-        if (fen[pos] == '\0')
+        return false;
+    }
+
+    return set_position(game, board, active_color, castling_rights, en_passant_x, clocks[0], clocks[1]);
+}
+
+bool set_position(game *game, piece_type board[8][8], piece_color active_color, uint castling_rights, int en_passant_x,
+                  uint halfmove_clock, uint fullmove_number)
+{
+    if (active_color != CChessWhite && active_color != CChessBlack)
+    {
+        return false;
+    }
+
+    if (castling_rights > 15 || en_passant_x < -1 || en_passant_x > 7 || fullmove_number == 0)
+    {
+        return false;
+    }
+
+    // Validate the position itself: one king per side, no pawns on the back ranks
+    int white_kings = 0, black_kings = 0;
+    int king_x[2] = {-1, -1}, king_y[2] = {-1, -1};
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            if ((uint)board[i][j] > WhiteKing)
+            {
+                return false;
+            }
+
+            if (board[i][j] == WhiteKing || board[i][j] == BlackKing)
+            {
+                white_kings += board[i][j] == WhiteKing;
+                black_kings += board[i][j] == BlackKing;
+                king_x[get_piece_color(board[i][j])] = j;
+                king_y[get_piece_color(board[i][j])] = i;
+            }
+
+            if ((i == 0 || i == 7) && (board[i][j] == WhitePawn || board[i][j] == BlackPawn))
+            {
+                return false;
+            }
+        }
+    }
+
+    if (white_kings != 1 || black_kings != 1)
+    {
+        return false;
+    }
+
+    // Castling rights need king and rook on their start squares
+    if (((castling_rights & (CastleWhiteKingside | CastleWhiteQueenside)) && board[7][4] != WhiteKing) ||
+        ((castling_rights & (CastleBlackKingside | CastleBlackQueenside)) && board[0][4] != BlackKing) ||
+        ((castling_rights & CastleWhiteKingside) && board[7][7] != WhiteRook) ||
+        ((castling_rights & CastleWhiteQueenside) && board[7][0] != WhiteRook) ||
+        ((castling_rights & CastleBlackKingside) && board[0][7] != BlackRook) ||
+        ((castling_rights & CastleBlackQueenside) && board[0][0] != BlackRook))
+    {
+        return false;
+    }
+
+    // The en passant square needs the pawn that just moved in front of it and both squares it passed empty
+    if (en_passant_x != -1)
+    {
+        int pawn_row = (active_color == CChessWhite) ? 3 : 4;
+        int skipped_row = (active_color == CChessWhite) ? 2 : 5;
+        int start_row = (active_color == CChessWhite) ? 1 : 6;
+        piece_type pawn = (active_color == CChessWhite) ? BlackPawn : WhitePawn;
+
+        if (board[pawn_row][en_passant_x] != pawn ||
+            board[skipped_row][en_passant_x] != EMPTY ||
+            board[start_row][en_passant_x] != EMPTY)
         {
-            printf("Error: Expected space after halfmove clock\n");
             return false;
         }
-        pos++;
     }
-    pos++; // Skip the space
 
-    // 6. Skip fullmove number (for now)
-    while (fen[pos] != '\0' && fen[pos] != ' ')
+    // The side that just moved can't have left its king in check
+    if (is_board_square_attacked(board, king_x[!active_color], king_y[!active_color], active_color))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 8; i++)
     {
-        pos++;
+        for (int j = 0; j < 8; j++)
+        {
+            game->board[i][j] = board[i][j];
+        }
     }
 
+    game->current_turn = active_color;
+    game->castling_rights = castling_rights;
+    game->en_passant_x = en_passant_x;
+    game->halfmove_clock = halfmove_clock;
+    game->fullmove_number = fullmove_number;
+
     // Reset move history since we're loading a new position
-    game->move_history = (move_list){.moves = {}, .count = 0};
+    game->move_history.count = 0;
     game->status = InProgress;
+    refresh_position_state(game);
 
-    printf("FEN import completed successfully\n");
     return true;
 }
 
 void export_FEN(game *game, char *str_buffer)
 {
+    INSTRUMENT_FUNCTION(InstrumentExportFEN);
     int empty_count = 0;
     int buffer_pos = 0;
 
@@ -953,52 +1746,500 @@ void export_FEN(game *game, char *str_buffer)
     // 3. Castling availability
     str_buffer[buffer_pos++] = ' ';
     bool has_castling = false;
+    const char castling_chars[4] = {'K', 'Q', 'k', 'q'};
 
-    if (!has_king_moved(game, CChessWhite))
+    for (int i = 0; i < 4; i++)
     {
-        if (!has_rook_moved(game, CChessWhite, true))
+        if (game->castling_rights & (1u << i))
         {
-            str_buffer[buffer_pos++] = 'K';
+            str_buffer[buffer_pos++] = castling_chars[i];
             has_castling = true;
         }
-        if (!has_rook_moved(game, CChessWhite, false))
+    }
+
+    if (!has_castling)
+    {
+        str_buffer[buffer_pos++] = '-';
+    }
+
+    // 4. En passant target square, the square the pawn skipped over
+    str_buffer[buffer_pos++] = ' ';
+    if (game->en_passant_x != -1)
+    {
+        str_buffer[buffer_pos++] = 'a' + game->en_passant_x;
+        str_buffer[buffer_pos++] = (game->current_turn == CChessWhite) ? '6' : '3';
+    }
+    else
+    {
+        str_buffer[buffer_pos++] = '-';
+    }
+
+    // 5. Halfmove clock and 6. fullmove number
+    sprintf(str_buffer + buffer_pos, " %u %u", game->halfmove_clock, game->fullmove_number);
+}
+
+bool move_from_SAN(game *game, const char *san, move *out)
+{
+    INSTRUMENT_FUNCTION(InstrumentMoveFromSAN);
+    piece_color color = game->current_turn;
+    int king_x = game->king_x[color];
+    int king_y = game->king_y[color];
+
+    // Length without check, mate and annotation suffixes
+    int length = 0;
+    while (san[length] != '\0' && san[length] != '+' && san[length] != '#' && san[length] != '!' && san[length] != '?' && san[length] != ' ')
+    {
+        length++;
+    }
+
+    // Castling, also accepting the zero spelling some programs write
+    if (length >= 3 && (san[0] == 'O' || san[0] == '0'))
+    {
+        bool queenside;
+        if (length == 3 && san[1] == '-' && san[2] == san[0])
+        {
+            queenside = false;
+        }
+        else if (length == 5 && san[1] == '-' && san[2] == san[0] && san[3] == '-' && san[4] == san[0])
         {
-            str_buffer[buffer_pos++] = 'Q';
-            has_castling = true;
+            queenside = true;
         }
+        else
+        {
+            return false;
+        }
+
+        if (king_x == -1)
+        {
+            return false;
+        }
+
+        move king_moves[MAX_PIECE_MOVES];
+        uint king_move_count = 0;
+        add_pseudo_legal_moves(game, king_x, king_y, king_moves, &king_move_count);
+        for (uint i = 0; i < king_move_count; i++)
+        {
+            if (king_moves[i].x_to == king_x + (queenside ? -2 : 2))
+            {
+                *out = king_moves[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    piece_type piece = piece_from_char(san[0], color);
+    int pos = (piece == EMPTY) ? 0 : 1;
+    if (piece == EMPTY)
+    {
+        piece = (color == CChessWhite) ? WhitePawn : BlackPawn;
+    }
+
+    // Promotion suffix, "=Q" or just "Q"
+    piece_type promotion = EMPTY;
+    if (length >= 2 && piece_from_char(san[length - 1], color) != EMPTY)
+    {
+        promotion = piece_from_char(san[length - 1], color);
+        length -= (san[length - 2] == '=') ? 2 : 1;
+    }
+
+    // The last two characters left are the target square, anything between the piece and the target disambiguates
+    if (length - pos < 2)
+    {
+        return false;
     }
 
-    if (!has_king_moved(game, CChessBlack))
+    int to_x = san[length - 2] - 'a';
+    int to_y = '8' - san[length - 1];
+    if (!is_within_bounds(to_x, to_y))
     {
-        if (!has_rook_moved(game, CChessBlack, true))
+        return false;
+    }
+
+    int from_x = -1, from_y = -1;
+    bool capture = false;
+    for (int i = pos; i < length - 2; i++)
+    {
+        char c = san[i];
+        if (c >= 'a' && c <= 'h')
         {
-            str_buffer[buffer_pos++] = 'k';
-            has_castling = true;
+            from_x = c - 'a';
         }
-        if (!has_rook_moved(game, CChessBlack, false))
+        else if (c >= '1' && c <= '8')
         {
-            str_buffer[buffer_pos++] = 'q';
-            has_castling = true;
+            from_y = '8' - c;
+        }
+        else if (c == 'x' || c == ':')
+        {
+            capture = true;
+        }
+        else if (c != '-')
+        {
+            return false;
         }
     }
 
-    if (!has_castling)
+    piece_type target = game->board[to_y][to_x];
+    if (target != EMPTY && get_piece_color(target) == color)
     {
-        str_buffer[buffer_pos++] = '-';
+        return false;
     }
 
-    // 4. En passant target square (simplified - always '-' for now)
-    str_buffer[buffer_pos++] = ' ';
-    str_buffer[buffer_pos++] = '-';
+    move candidates[16];
+    uint candidate_count = 0;
 
-    // 5. Halfmove clock (always 0 for now)
-    str_buffer[buffer_pos++] = ' ';
-    str_buffer[buffer_pos++] = '0';
+    if (piece == WhitePawn || piece == BlackPawn)
+    {
+        int direction = (piece == WhitePawn) ? -1 : 1;
+        int start_row = (piece == WhitePawn) ? 6 : 1;
+        int last_row = (piece == WhitePawn) ? 0 : 7;
 
-    // 6. Fullmove number (always 1 for now)
-    str_buffer[buffer_pos++] = ' ';
-    str_buffer[buffer_pos++] = '1';
+        if ((to_y == last_row) != (promotion != EMPTY) || promotion == WhiteKing || promotion == BlackKing ||
+            promotion == WhitePawn || promotion == BlackPawn)
+        {
+            return false;
+        }
+
+        move m = {-1, to_y - direction, to_x, to_y, piece, target, promotion};
+
+        if (capture || (from_x != -1 && from_x != to_x))
+        {
+            // Captures name the file they come from, en passant lands on the empty square behind the pawn
+            bool en_passant = target == EMPTY && to_x == game->en_passant_x && to_y == ((piece == WhitePawn) ? 2 : 5);
+            if (from_x == -1 || abs(from_x - to_x) != 1 || (target == EMPTY && !en_passant))
+            {
+                return false;
+            }
+            m.x_from = from_x;
+        }
+        else
+        {
+            if (target != EMPTY)
+            {
+                return false;
+            }
+
+            m.x_from = to_x;
+            if (is_within_bounds(to_x, m.y_from) && game->board[m.y_from][to_x] == EMPTY && to_y - 2 * direction == start_row)
+            {
+                m.y_from = start_row; // Double step
+            }
+        }
+
+        if (!is_within_bounds(m.x_from, m.y_from) || game->board[m.y_from][m.x_from] != piece)
+        {
+            return false;
+        }
+
+        candidates[candidate_count++] = m;
+    }
+    else
+    {
+        if (promotion != EMPTY)
+        {
+            return false;
+        }
+
+        move all[16];
+        uint count = get_piece_moves_to(game, piece, to_x, to_y, all, 16);
+        for (uint i = 0; i < count; i++)
+        {
+            if ((from_x == -1 || all[i].x_from == from_x) && (from_y == -1 || all[i].y_from == from_y))
+            {
+                candidates[candidate_count++] = all[i];
+            }
+        }
+    }
+
+    // Exactly one legal move has to match
+    check_info info = get_check_info(game, color);
+    bool found = false;
+    for (uint i = 0; i < candidate_count; i++)
+    {
+        if (is_legal_move(game, &info, candidates[i]))
+        {
+            if (found)
+            {
+                return false;
+            }
+            *out = candidates[i];
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void move_to_SAN(game *game, move m, char *str_buffer)
+{
+    INSTRUMENT_FUNCTION(InstrumentMoveToSAN);
+    int pos = 0;
+    piece_type piece = game->board[m.y_from][m.x_from];
+    bool is_pawn = piece == WhitePawn || piece == BlackPawn;
+
+    if ((piece == WhiteKing || piece == BlackKing) && abs(m.x_to - m.x_from) == 2)
+    {
+        pos += sprintf(str_buffer, (m.x_to > m.x_from) ? "O-O" : "O-O-O");
+    }
+    else
+    {
+        bool capture = game->board[m.y_to][m.x_to] != EMPTY || (is_pawn && m.x_from != m.x_to);
 
-    // Null terminate the string
-    str_buffer[buffer_pos] = '\0';
-}
\ No newline at end of file
+        if (is_pawn)
+        {
+            if (capture)
+            {
+                str_buffer[pos++] = 'a' + m.x_from;
+            }
+        }
+        else
+        {
+            const char piece_chars[] = " PRNBQK";
+            str_buffer[pos++] = piece_chars[(piece - 1) % 6 + 1];
+
+            // Other pieces of the same kind reaching the same square decide what has to be spelled out
+            move others[16];
+            uint count = get_piece_moves_to(game, piece, m.x_to, m.y_to, others, 16);
+            check_info info = get_check_info(game, get_piece_color(piece));
+            bool ambiguous = false, same_file = false, same_rank = false;
+
+            for (uint i = 0; i < count; i++)
+            {
+                if ((others[i].x_from == m.x_from && others[i].y_from == m.y_from) || !is_legal_move(game, &info, others[i]))
+                {
+                    continue;
+                }
+                ambiguous = true;
+                same_file |= others[i].x_from == m.x_from;
+                same_rank |= others[i].y_from == m.y_from;
+            }
+
+            if (ambiguous && (!same_file || same_rank))
+            {
+                str_buffer[pos++] = 'a' + m.x_from;
+            }
+            if (ambiguous && same_file)
+            {
+                str_buffer[pos++] = '8' - m.y_from;
+            }
+        }
+
+        if (capture)
+        {
+            str_buffer[pos++] = 'x';
+        }
+
+        str_buffer[pos++] = 'a' + m.x_to;
+        str_buffer[pos++] = '8' - m.y_to;
+
+        if (m.promotion_piece != EMPTY)
+        {
+            const char piece_chars[] = " PRNBQK";
+            str_buffer[pos++] = '=';
+            str_buffer[pos++] = piece_chars[(m.promotion_piece - 1) % 6 + 1];
+        }
+    }
+
+    make_move(game, m);
+    if (is_in_check(game, game->current_turn))
+    {
+        str_buffer[pos++] = has_legal_move(game, game->current_turn) ? '+' : '#';
+    }
+    undo_last_move(game);
+
+    str_buffer[pos] = '\0';
+}
+
+void move_to_UCI(move m, char *str_buffer)
+{
+    int pos = 0;
+    str_buffer[pos++] = 'a' + m.x_from;
+    str_buffer[pos++] = '8' - m.y_from;
+    str_buffer[pos++] = 'a' + m.x_to;
+    str_buffer[pos++] = '8' - m.y_to;
+
+    if (m.promotion_piece != EMPTY)
+    {
+        const char piece_chars[] = " prnbqk";
+        str_buffer[pos++] = piece_chars[(m.promotion_piece - 1) % 6 + 1];
+    }
+
+    str_buffer[pos] = '\0';
+}
+
+bool move_from_UCI(game *game, const char *str, move *out)
+{
+    if (str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8' ||
+        str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+    {
+        return false;
+    }
+
+    int x_from = str[0] - 'a', y_from = '8' - str[1];
+    int x_to = str[2] - 'a', y_to = '8' - str[3];
+    char promotion = str[4];
+    bool has_promotion = promotion != '\0' && promotion != ' ' && promotion != '\n' && promotion != '\r';
+    if (has_promotion && str[5] != '\0' && str[5] != ' ' && str[5] != '\n' && str[5] != '\r')
+    {
+        return false;
+    }
+
+    // Only lowercase promotion letters, anything else after the squares isn't a move
+    piece_type promotion_piece = EMPTY;
+    if (has_promotion)
+    {
+        if (promotion < 'a' || promotion > 'z' || promotion == 'k')
+        {
+            return false;
+        }
+        promotion_piece = piece_from_char(promotion - 'a' + 'A', game->current_turn);
+        if (promotion_piece == EMPTY)
+        {
+            return false;
+        }
+    }
+
+    // get_valid_moves doesn't care whose turn it is
+    piece_type moving = game->board[y_from][x_from];
+    if (moving == EMPTY || get_piece_color(moving) != game->current_turn)
+    {
+        return false;
+    }
+
+    move_list moves = get_valid_moves(game, x_from, y_from);
+    for (uint i = 0; i < moves.count; i++)
+    {
+        move m = moves.moves[i];
+        if (m.x_to == x_to && m.y_to == y_to && m.promotion_piece == promotion_piece)
+        {
+            *out = m;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FEN_from_EPD(const char *line, char *fen, size_t size)
+{
+    size_t length = 0;
+    int field = 0;
+    const char *p = line;
+
+    while (field < 6)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+
+        if (*p == '\0' || *p == '\n' || *p == '\r' || *p == ';' || (field == 0 && *p == '#'))
+        {
+            break;
+        }
+
+        const char *end = p;
+        while (*end != '\0' && *end != ' ' && *end != '\t' && *end != '\n' && *end != '\r' && *end != ';')
+        {
+            end++;
+        }
+
+        // EPD operations follow the fourth field, only numeric fields are clocks
+        if (field >= 4 && (*p < '0' || *p > '9'))
+        {
+            break;
+        }
+
+        size_t token_length = end - p;
+        if (length + token_length + 2 > size)
+        {
+            break;
+        }
+
+        if (field > 0)
+        {
+            fen[length++] = ' ';
+        }
+        memcpy(fen + length, p, token_length);
+        length += token_length;
+        field++;
+        p = end;
+    }
+
+    fen[length] = '\0';
+    return field > 0;
+}
+
+// Pseudo legal moves of all pieces of one type that end on the given square, found by looking outwards from the square
+static uint get_piece_moves_to(game *game, piece_type piece, int x, int y, move *out, uint max_moves)
+{
+    uint count = 0;
+    piece_type target = game->board[y][x];
+
+    int knight_moves[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+    int directions[8][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+    if (piece == WhiteKnight || piece == BlackKnight || piece == WhiteKing || piece == BlackKing)
+    {
+        int(*offsets)[2] = (piece == WhiteKnight || piece == BlackKnight) ? knight_moves : directions;
+        for (int i = 0; i < 8 && count < max_moves; i++)
+        {
+            int from_x = x + offsets[i][0];
+            int from_y = y + offsets[i][1];
+            if (is_within_bounds(from_x, from_y) && game->board[from_y][from_x] == piece)
+            {
+                out[count++] = (move){from_x, from_y, x, y, piece, target, EMPTY};
+            }
+        }
+        return count;
+    }
+
+    bool straight = piece == WhiteRook || piece == BlackRook || piece == WhiteQueen || piece == BlackQueen;
+    bool diagonal = piece == WhiteBishop || piece == BlackBishop || piece == WhiteQueen || piece == BlackQueen;
+
+    for (int d = 0; d < 8 && count < max_moves; d++)
+    {
+        if ((d < 4 && !straight) || (d >= 4 && !diagonal))
+        {
+            continue;
+        }
+
+        int from_x = x + directions[d][0];
+        int from_y = y + directions[d][1];
+        while (is_within_bounds(from_x, from_y))
+        {
+            if (game->board[from_y][from_x] != EMPTY)
+            {
+                if (game->board[from_y][from_x] == piece)
+                {
+                    out[count++] = (move){from_x, from_y, x, y, piece, target, EMPTY};
+                }
+                break;
+            }
+            from_x += directions[d][0];
+            from_y += directions[d][1];
+        }
+    }
+
+    return count;
+}
+
+static piece_type piece_from_char(char c, piece_color color)
+{
+    bool white = color == CChessWhite;
+    switch (c)
+    {
+    case 'N':
+        return white ? WhiteKnight : BlackKnight;
+    case 'B':
+        return white ? WhiteBishop : BlackBishop;
+    case 'R':
+        return white ? WhiteRook : BlackRook;
+    case 'Q':
+        return white ? WhiteQueen : BlackQueen;
+    case 'K':
+        return white ? WhiteKing : BlackKing;
+    default:
+        return EMPTY;
+    }
+}
@@ -1,9 +1,24 @@
 #ifndef CHESS_H
 #define CHESS_H
 
+// Public header of the rules engine, also shipped with libcchess. The major version changes whenever a declaration
+// or the layout of a struct below changes incompatibly, the minor version when something is added
+#define CCHESS_VERSION_MAJOR 1
+#define CCHESS_VERSION_MINOR 1
+
 #define MAX_MOVES 1024
+#define MAX_POSITION_MOVES 256 // Legal moves of one position, the most any position has is 218
+
+// Increment of game.material_key for one piece of the given type
+#define MATERIAL_KEY_UNIT(piece) (1ULL << (4 * ((piece) - 1)))
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef unsigned int uint;
 
@@ -35,9 +50,20 @@ typedef enum
     InProgress,
     WhiteWon,
     BlackWon,
-    Stalemate
+    Stalemate,
+    InsufficientMaterial,
+    FiftyMoveRule,
+    ThreefoldRepetition
 } game_status;
 
+typedef enum
+{
+    CastleWhiteKingside = 1,
+    CastleWhiteQueenside = 2,
+    CastleBlackKingside = 4,
+    CastleBlackQueenside = 8
+} castling_right;
+
 extern const char *piece_strings[];
 
 typedef struct
@@ -48,6 +74,7 @@ typedef struct
     int y_to;
     piece_type origin_piece;
     piece_type destination_piece;
+    piece_type promotion_piece; // EMPTY unless a pawn reaches the last rank
 } move;
 
 typedef struct
@@ -56,6 +83,15 @@ typedef struct
     uint count;
 } move_list;
 
+// State that a move can't be undone from, saved per ply so undo_last_move can restore it
+typedef struct
+{
+    uint64_t hash; // Zobrist key of the position before the move
+    uint16_t halfmove_clock;
+    uint8_t castling_rights;
+    int8_t en_passant_x;
+} ply_state;
+
 typedef enum
 {
     None,
@@ -70,8 +106,26 @@ typedef struct
     piece_color current_turn;
     game_status status;
     move_list move_history;
+    int king_x[2]; // Indexed by piece_color, -1 if that king is not on the board
+    int king_y[2];
+    uint64_t material_key; // 4 bits per piece type holding its count, see MATERIAL_KEY_UNIT
+    uint castling_rights;  // castling_right flags
+    int en_passant_x;      // File of a pawn that just moved two squares, -1 if there is none
+    uint halfmove_clock;   // Plies since the last capture or pawn move
+    uint fullmove_number;
+    uint64_t hash; // Zobrist key of the current position
+    ply_state state_history[MAX_MOVES]; // Parallel to move_history
 } game;
 
+// Thread safety: every function only reads and writes the game passed to it, apart from global tables that are filled
+// once and only read afterwards. Different games can be used from different threads at the same time without locking.
+// One game must not be used by two threads at once, not even for queries: move_to_SAN and the game over checks play
+// moves on it and take them back. Nothing is printed.
+
+// Fills the global tables. Called by everything that sets up a game, so calling it is optional. Safe to call from
+// several threads at once, all of them return once the tables are complete
+void chess_init();
+
 game init_game();
 
 void reset_game(game *game);
@@ -80,6 +134,21 @@ bool is_within_bounds(int x, int y);
 
 move_list get_valid_moves(game *game, int x, int y);
 
+// All legal moves of the side to move
+move_list get_all_valid_moves(game *game);
+
+// Looks up the legal move of the side to move between two squares, with promotion_piece EMPTY unless it promotes.
+// Fills in the pieces, for moves that only come as squares (packed or from a file). Any coordinates are accepted
+bool find_legal_move(game *game, int x_from, int y_from, int x_to, int y_to, piece_type promotion_piece, move *out);
+
+// Same without the MAX_MOVES sized list, for recursive callers. out needs room for MAX_POSITION_MOVES, returns the count
+uint generate_legal_moves(game *game, move *out);
+
+bool is_in_check(game *game, piece_color color);
+
+// Number of leaf nodes of the legal move tree, depth in plies
+uint64_t perft(game *game, int depth);
+
 move_result make_move(game *game, move move);
 
 void undo_last_move(game *game);
@@ -88,8 +157,39 @@ piece_color get_piece_color(piece_type piece);
 
 game_status check_game_over(game *game);
 
+// Number of earlier occurrences of the current position, only looking back to the last capture or pawn move
+uint repetition_count(game *game);
+
 bool import_FEN(game *game, const char *fen);
 
+// Sets up a position from its parts after the same legality checks import_FEN does, the game is untouched on failure.
+// en_passant_x is the file of a pawn that just moved two squares or -1
+bool set_position(game *game, piece_type board[8][8], piece_color active_color, uint castling_rights, int en_passant_x,
+                  uint halfmove_clock, uint fullmove_number);
+
+// Whether the side to move has a pawn next to the en passant pawn, only then does the en passant square matter
+bool can_capture_en_passant(game *game);
+
 void export_FEN(game *game, char *str_buffer);
 
-#endif
\ No newline at end of file
+// Resolves a move in standard algebraic notation ("Nbd7", "exd6", "e8=Q+", "O-O") to the legal move it names
+bool move_from_SAN(game *game, const char *san, move *out);
+
+// Writes the move in standard algebraic notation, including the check or mate suffix. The move has to be legal
+void move_to_SAN(game *game, move m, char *str_buffer);
+
+// Long algebraic notation as used by UCI engines: "e2e4", "e7e8q", castling as the king move "e1g1"
+void move_to_UCI(move m, char *str_buffer);
+
+// Resolves a long algebraic move to the legal move it names, the string may continue after a space
+bool move_from_UCI(game *game, const char *str, move *out);
+
+// Cuts an EPD line down to a FEN: the four position fields plus the clocks if they are present.
+// Returns false for blank lines and comments
+bool FEN_from_EPD(const char *line, char *fen, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
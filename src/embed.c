@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Build step for the GUI: writes the given files into a C source file as byte arrays, listed in embedded_assets
+// (see assets.h) under their path with the prefix taken off:
+//   embed <output.c> <prefix> <file>...
+// The output is only replaced once it's complete, so a failed run doesn't leave half an array for make to pick up
+
+static bool write_asset(FILE *out, const char *path, int index);
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <output.c> <prefix> <file>...\n", argv[0]);
+        return 1;
+    }
+
+    const char *output = argv[1];
+    const char *prefix = argv[2];
+    size_t prefix_length = strlen(prefix);
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", output);
+    FILE *out = fopen(temp_path, "w");
+    if (out == NULL)
+    {
+        perror(temp_path);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by src/embed.c, don't edit\n#include \"assets.h\"\n\n");
+
+    bool ok = true;
+    for (int i = 3; i < argc && ok; i++)
+    {
+        ok = write_asset(out, argv[i], i - 3);
+    }
+
+    if (ok)
+    {
+        fprintf(out, "const embedded_asset embedded_assets[] = {\n");
+        for (int i = 3; i < argc; i++)
+        {
+            const char *name = argv[i];
+            if (strncmp(name, prefix, prefix_length) == 0)
+            {
+                name += prefix_length;
+            }
+            fprintf(out, "    {\"%s\", asset_%d, sizeof(asset_%d)},\n", name, i - 3, i - 3);
+        }
+        fprintf(out, "};\n\nconst unsigned int embedded_asset_count = %d;\n", argc - 3);
+    }
+
+    if (fclose(out) != 0 || !ok)
+    {
+        remove(temp_path);
+        return 1;
+    }
+    if (rename(temp_path, output) != 0)
+    {
+        perror(output);
+        remove(temp_path);
+        return 1;
+    }
+    return 0;
+}
+
+static bool write_asset(FILE *out, const char *path, int index)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    fprintf(out, "// %s\nstatic const unsigned char asset_%d[] = {", path, index);
+
+    unsigned char buffer[4096];
+    size_t read, total = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+        for (size_t i = 0; i < read; i++, total++)
+        {
+            fprintf(out, "%s0x%02x,", (total % 16 == 0) ? "\n    " : "", buffer[i]);
+        }
+    }
+
+    bool ok = !ferror(in);
+    if (!ok)
+    {
+        perror(path);
+    }
+    else if (total == 0)
+    {
+        // C has no empty arrays
+        fprintf(stderr, "%s: File is empty\n", path);
+        ok = false;
+    }
+    fclose(in);
+
+    fprintf(out, "\n};\n\n");
+    return ok;
+}
@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gamedb.h"
+
+#define GAMEDB_HEADER_SIZE 24
+
+static bool write_bytes(gamedb_writer *writer, const void *data, size_t size);
+
+gamedb_move gamedb_pack_move(move m)
+{
+    uint promotion = 0;
+    switch (m.promotion_piece)
+    {
+    case WhiteKnight:
+    case BlackKnight:
+        promotion = 1;
+        break;
+    case WhiteBishop:
+    case BlackBishop:
+        promotion = 2;
+        break;
+    case WhiteRook:
+    case BlackRook:
+        promotion = 3;
+        break;
+    case WhiteQueen:
+    case BlackQueen:
+        promotion = 4;
+        break;
+    default:
+        break;
+    }
+
+    return (gamedb_move)((m.y_from * 8 + m.x_from) | ((m.y_to * 8 + m.x_to) << 6) | (promotion << 12));
+}
+
+move gamedb_unpack_move(game *game, gamedb_move packed)
+{
+    int from = packed & 63;
+    int to = (packed >> 6) & 63;
+    uint promotion = (packed >> 12) & 7;
+
+    move m = {from % 8, from / 8, to % 8, to / 8, game->board[from / 8][from % 8], game->board[to / 8][to % 8], EMPTY};
+
+    if (promotion != 0 && promotion <= 4 && m.origin_piece != EMPTY)
+    {
+        piece_type white_pieces[] = {EMPTY, WhiteKnight, WhiteBishop, WhiteRook, WhiteQueen};
+        piece_type black_pieces[] = {EMPTY, BlackKnight, BlackBishop, BlackRook, BlackQueen};
+        m.promotion_piece = (get_piece_color(m.origin_piece) == CChessWhite) ? white_pieces[promotion] : black_pieces[promotion];
+    }
+
+    return m;
+}
+
+bool gamedb_unpack_legal_move(game *game, gamedb_move packed, move *out)
+{
+    move m = gamedb_unpack_move(game, packed);
+    if (((packed >> 12) & 7) != 0 && m.promotion_piece == EMPTY)
+    {
+        return false;
+    }
+
+    return find_legal_move(game, m.x_from, m.y_from, m.x_to, m.y_to, m.promotion_piece, out);
+}
+
+gamedb *gamedb_open(const char *path)
+{
+    gamedb *db = calloc(1, sizeof(gamedb));
+    if (db == NULL)
+    {
+        return NULL;
+    }
+
+    if (!map_file(path, &db->file))
+    {
+        free(db);
+        return NULL;
+    }
+    db->data = db->file.data;
+    db->size = db->file.size;
+
+    // Validate everything gamedb_get_game relies on once, so lookups don't have to
+    uint32_t version;
+    uint64_t index_offset;
+    if (db->size < GAMEDB_HEADER_SIZE || memcmp(db->data, GAMEDB_MAGIC, 4) != 0)
+    {
+        gamedb_close(db);
+        return NULL;
+    }
+
+    memcpy(&version, db->data + 4, sizeof(version));
+    memcpy(&db->game_count, db->data + 8, sizeof(db->game_count));
+    memcpy(&index_offset, db->data + 16, sizeof(index_offset));
+
+    if (version != GAMEDB_VERSION || index_offset % 8 != 0 || index_offset > db->size ||
+        db->game_count > (db->size - index_offset) / sizeof(uint64_t))
+    {
+        gamedb_close(db);
+        return NULL;
+    }
+
+    db->index = (const uint64_t *)(db->data + index_offset);
+    return db;
+}
+
+void gamedb_close(gamedb *db)
+{
+    if (db == NULL)
+    {
+        return;
+    }
+
+    unmap_file(&db->file);
+    free(db);
+}
+
+bool gamedb_get_game(const gamedb *db, uint64_t n, gamedb_game *out)
+{
+    if (n >= db->game_count)
+    {
+        return false;
+    }
+
+    uint64_t offset = db->index[n];
+    if (offset % 2 != 0 || offset + 4 > db->size)
+    {
+        return false;
+    }
+
+    const uint8_t *record = db->data + offset;
+    uint16_t ply_count;
+    memcpy(&ply_count, record, sizeof(ply_count));
+    uint fen_length = record[3];
+    uint64_t moves_offset = offset + 4 + fen_length + (fen_length & 1);
+
+    if (moves_offset + ply_count * sizeof(gamedb_move) > db->size || record[2] > PgnDraw ||
+        (fen_length > 0 && record[4 + fen_length - 1] != '\0'))
+    {
+        return false;
+    }
+
+    out->ply_count = ply_count;
+    out->result = record[2];
+    out->fen = (fen_length > 0) ? (const char *)record + 4 : NULL;
+    out->moves = (const gamedb_move *)(db->data + moves_offset);
+    return true;
+}
+
+bool gamedb_replay(const gamedb_game *record, game *out)
+{
+    if (record->fen != NULL)
+    {
+        if (!import_FEN(out, record->fen))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        reset_game(out);
+    }
+
+    // The moves come straight from the file, a corrupt one must not reach make_move
+    for (uint i = 0; i < record->ply_count; i++)
+    {
+        move m;
+        if (out->move_history.count >= MAX_MOVES || !gamedb_unpack_legal_move(out, record->moves[i], &m))
+        {
+            return false;
+        }
+        make_move(out, m);
+    }
+
+    return true;
+}
+
+gamedb_writer *gamedb_create(const char *path)
+{
+    gamedb_writer *writer = calloc(1, sizeof(gamedb_writer));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL)
+    {
+        free(writer);
+        return NULL;
+    }
+
+    // Header is rewritten with the real counts by gamedb_finish
+    uint8_t header[GAMEDB_HEADER_SIZE] = {0};
+    if (!write_bytes(writer, header, sizeof(header)))
+    {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+bool gamedb_write_game(gamedb_writer *writer, const char *fen, const move_list *moves, pgn_result result)
+{
+    size_t fen_length = (fen != NULL) ? strlen(fen) + 1 : 0;
+    if (fen_length > 255 || moves->count > 0xFFFF)
+    {
+        return false;
+    }
+
+    if (writer->game_count == writer->index_capacity)
+    {
+        uint64_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 1024;
+        uint64_t *index = realloc(writer->index, capacity * sizeof(uint64_t));
+        if (index == NULL)
+        {
+            return false;
+        }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+    writer->index[writer->game_count] = writer->offset;
+
+    uint16_t ply_count = moves->count;
+    uint8_t header[4];
+    memcpy(header, &ply_count, sizeof(ply_count));
+    header[2] = result;
+    header[3] = fen_length;
+
+    gamedb_move packed[MAX_MOVES];
+    for (uint i = 0; i < moves->count; i++)
+    {
+        packed[i] = gamedb_pack_move(moves->moves[i]);
+    }
+
+    uint8_t padding = 0;
+    if (!write_bytes(writer, header, sizeof(header)) ||
+        (fen_length > 0 && !write_bytes(writer, fen, fen_length)) ||
+        ((fen_length & 1) && !write_bytes(writer, &padding, 1)) ||
+        !write_bytes(writer, packed, moves->count * sizeof(gamedb_move)))
+    {
+        return false;
+    }
+
+    writer->game_count++;
+    return true;
+}
+
+bool gamedb_finish(gamedb_writer *writer)
+{
+    bool ok = true;
+    uint8_t padding[8] = {0};
+
+    uint64_t index_offset = (writer->offset + 7) & ~7ULL;
+    ok = ok && write_bytes(writer, padding, index_offset - writer->offset);
+    ok = ok && write_bytes(writer, writer->index, writer->game_count * sizeof(uint64_t));
+
+    uint8_t header[GAMEDB_HEADER_SIZE];
+    uint32_t version = GAMEDB_VERSION;
+    memcpy(header, GAMEDB_MAGIC, 4);
+    memcpy(header + 4, &version, sizeof(version));
+    memcpy(header + 8, &writer->game_count, sizeof(writer->game_count));
+    memcpy(header + 16, &index_offset, sizeof(index_offset));
+
+    ok = ok && fseek(writer->file, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(header, 1, sizeof(header), writer->file) == sizeof(header);
+    ok = (fclose(writer->file) == 0) && ok;
+
+    free(writer->index);
+    free(writer);
+    return ok;
+}
+
+static bool write_bytes(gamedb_writer *writer, const void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (fwrite(data, 1, size, writer->file) != size)
+    {
+        return false;
+    }
+
+    writer->offset += size;
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef GAMEDB_H
+#define GAMEDB_H
+
+#include <stddef.h>
+#include "chess.h"
+#include "mapfile.h"
+#include "pgn.h"
+
+// Binary game database, written once and then mapped read-only. Integers are written and read in place in the
+// machine's byte order, which the check below makes little endian, the same as the index and tree files.
+//
+//   header      magic "CCDB", u32 version, u64 game count, u64 index offset
+//   records     per game: u16 ply count, u8 result (pgn_result), u8 FEN length (0 for the initial position,
+//               otherwise including the terminating zero), the FEN padded to an even length, u16 moves[ply count]
+//   index       u64 record offset per game, 8 byte aligned
+//
+// Records have an even length, so the move stream of every game can be read in place as a gamedb_move array
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The database files are mapped and read in place, which needs a little endian machine"
+#endif
+
+#define GAMEDB_MAGIC "CCDB"
+#define GAMEDB_VERSION 1
+
+// Move packed into 16 bits: from square (6 bits), to square (6 bits), promotion (3 bits, see gamedb_pack_move).
+// Squares are y * 8 + x like everywhere else
+typedef uint16_t gamedb_move;
+
+typedef struct
+{
+    uint ply_count;
+    pgn_result result;
+    const char *fen; // NULL if the game starts from the initial position
+    const gamedb_move *moves; // Points into the mapped file
+} gamedb_game;
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    uint64_t game_count;
+    const uint64_t *index;
+    mapped_file file;
+} gamedb;
+
+typedef struct
+{
+    FILE *file;
+    uint64_t offset;
+    uint64_t *index;
+    uint64_t game_count;
+    uint64_t index_capacity;
+} gamedb_writer;
+
+gamedb_move gamedb_pack_move(move m);
+
+// Expands a packed move against the position it is played in, so origin and destination pieces are filled in.
+// Only for moves known to be legal there, like the ones of an index built from the database
+move gamedb_unpack_move(game *game, gamedb_move packed);
+
+// For moves read from a file: fails unless the move is legal in the position
+bool gamedb_unpack_legal_move(game *game, gamedb_move packed, move *out);
+
+// Maps a database file, returns NULL if it is missing or not a valid database
+gamedb *gamedb_open(const char *path);
+
+void gamedb_close(gamedb *db);
+
+// O(1), the returned record points straight into the mapping and stays valid until gamedb_close
+bool gamedb_get_game(const gamedb *db, uint64_t n, gamedb_game *out);
+
+// Sets up the start position of the record and plays its moves, filling out->move_history. Fails on a corrupt record,
+// out is then left somewhere in the game
+bool gamedb_replay(const gamedb_game *record, game *out);
+
+gamedb_writer *gamedb_create(const char *path);
+
+// fen is NULL for games from the initial position, moves are the mainline in order
+bool gamedb_write_game(gamedb_writer *writer, const char *fen, const move_list *moves, pgn_result result);
+
+// Writes index and header and closes the file, the writer is freed either way
+bool gamedb_finish(gamedb_writer *writer);
+
+#endif
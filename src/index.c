@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gamedb.h"
+#include "posindex.h"
+#include "util.h"
+
+// Builds and queries a position index over a game database:
+//   cchess-index build [-t threads] [-p max ply] <games.ccdb> <games.ccpi>
+//   cchess-index query [-n max games] <games.ccpi> "<FEN>"
+
+#define MAX_NEXT_MOVES 256
+
+static int build_index(int argc, char **argv);
+static int query_index(int argc, char **argv);
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "build") == 0)
+    {
+        return build_index(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "query") == 0)
+    {
+        return query_index(argc - 2, argv + 2);
+    }
+
+    fprintf(stderr, "Usage: %s build [-t threads] [-p max ply] <games.ccdb> <games.ccpi>\n", argv[0]);
+    fprintf(stderr, "       %s query [-n max games] <games.ccpi> \"<FEN>\"\n", argv[0]);
+    return 1;
+}
+
+static int build_index(int argc, char **argv)
+{
+    int threads = cpu_count();
+    uint max_ply = 0;
+    int arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (strcmp(argv[arg], "-t") == 0)
+        {
+            threads = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-p") == 0)
+        {
+            max_ply = atoi(argv[arg + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (argc - arg != 2)
+    {
+        fprintf(stderr, "build needs a database and an output file\n");
+        return 1;
+    }
+
+    gamedb *db = gamedb_open(argv[arg]);
+    if (db == NULL)
+    {
+        fprintf(stderr, "%s: not a game database\n", argv[arg]);
+        return 1;
+    }
+
+    double start = now_seconds();
+    bool ok = posindex_build(db, argv[arg + 1], threads, max_ply);
+    double elapsed = now_seconds() - start;
+
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", argv[arg + 1]);
+    }
+    else
+    {
+        fprintf(stderr, "games: %llu, threads: %d, time: %.3f s\n", (unsigned long long)db->game_count, threads, elapsed);
+    }
+
+    gamedb_close(db);
+    return ok ? 0 : 1;
+}
+
+static int query_index(int argc, char **argv)
+{
+    uint64_t max_games = 20;
+    int arg = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0)
+    {
+        max_games = strtoull(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+
+    if (argc - arg != 2)
+    {
+        fprintf(stderr, "query needs an index file and a FEN\n");
+        return 1;
+    }
+
+    game *g = malloc(sizeof(game));
+    if (g == NULL || !import_FEN(g, argv[arg + 1]))
+    {
+        fprintf(stderr, "Invalid FEN '%s'\n", argv[arg + 1]);
+        free(g);
+        return 1;
+    }
+
+    posindex *index = posindex_open(argv[arg]);
+    if (index == NULL)
+    {
+        fprintf(stderr, "%s: not a position index\n", argv[arg]);
+        free(g);
+        return 1;
+    }
+
+    double start = now_seconds();
+    const posindex_entry *entries;
+    uint64_t count = posindex_find(index, g->hash, &entries);
+    posindex_move_stat stats[MAX_NEXT_MOVES];
+    uint stat_count = posindex_next_moves(index, g->hash, stats, MAX_NEXT_MOVES);
+    double elapsed = now_seconds() - start;
+
+    char san[16];
+    printf("positions: %llu\n", (unsigned long long)count);
+    for (uint i = 0; i < stat_count; i++)
+    {
+        move_to_SAN(g, gamedb_unpack_move(g, stats[i].move), san);
+        printf("  %-8s %u\n", san, stats[i].count);
+    }
+
+    for (uint64_t i = 0; i < count && i < max_games; i++)
+    {
+        if (entries[i].next_move == POSINDEX_NO_MOVE)
+        {
+            printf("game %u ply %u (final position)\n", entries[i].game, entries[i].ply);
+        }
+        else
+        {
+            move_to_SAN(g, gamedb_unpack_move(g, entries[i].next_move), san);
+            printf("game %u ply %u next %s\n", entries[i].game, entries[i].ply, san);
+        }
+    }
+
+    fprintf(stderr, "lookup: %.1f us\n", elapsed * 1e6);
+
+    posindex_close(index);
+    free(g);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include "instrument.h"
+
+#ifdef CCHESS_INSTRUMENT
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+#else
+#include <time.h>
+#define TICK_UNIT "ns"
+#endif
+
+typedef struct counter_block
+{
+    uint64_t calls[InstrumentFunctionCount];
+    uint64_t ticks[InstrumentFunctionCount];
+    uint64_t counters[InstrumentCounterCount];
+    struct counter_block *next;
+} counter_block;
+
+static counter_block *get_block();
+static uint64_t read_ticks();
+static void dump_at_exit();
+
+static const char *function_names[InstrumentFunctionCount] = {
+    "get_valid_moves", "generate_legal_moves", "add_pseudo_legal_moves", "is_square_attacked",
+    "is_in_check",     "get_check_info",       "is_legal_move",          "has_legal_move",
+    "make_move",       "undo_last_move",       "check_game_over",        "repetition_count",
+    "import_FEN",      "export_FEN",           "move_from_SAN",          "move_to_SAN",
+};
+
+static const char *counter_names[InstrumentCounterCount] = {"moves generated", "moves rejected as illegal"};
+
+// Blocks are never freed, so counts of threads that have exited still show up in the dump
+static _Thread_local counter_block *thread_block = NULL;
+static counter_block *all_blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+instrument_scope instrument_enter(instrument_function function)
+{
+    get_block()->calls[function]++;
+    return (instrument_scope){function, read_ticks()};
+}
+
+void instrument_leave(instrument_scope *scope)
+{
+    get_block()->ticks[scope->function] += read_ticks() - scope->start;
+}
+
+void instrument_add(instrument_counter counter, uint64_t amount)
+{
+    get_block()->counters[counter] += amount;
+}
+
+void instrument_dump(FILE *out)
+{
+    counter_block total = {0};
+
+    pthread_mutex_lock(&blocks_lock);
+    for (counter_block *block = all_blocks; block != NULL; block = block->next)
+    {
+        for (int i = 0; i < InstrumentFunctionCount; i++)
+        {
+            total.calls[i] += block->calls[i];
+            total.ticks[i] += block->ticks[i];
+        }
+        for (int i = 0; i < InstrumentCounterCount; i++)
+        {
+            total.counters[i] += block->counters[i];
+        }
+    }
+    pthread_mutex_unlock(&blocks_lock);
+
+    // Times include the functions called from inside, e.g. is_legal_move contains is_square_attacked
+    fprintf(out, "%-24s %14s %18s %12s\n", "function", "calls", "total " TICK_UNIT, "per call");
+    for (int i = 0; i < InstrumentFunctionCount; i++)
+    {
+        if (total.calls[i] == 0)
+        {
+            continue;
+        }
+        fprintf(out, "%-24s %14llu %18llu %12.1f\n", function_names[i], (unsigned long long)total.calls[i],
+                (unsigned long long)total.ticks[i], (double)total.ticks[i] / total.calls[i]);
+    }
+
+    for (int i = 0; i < InstrumentCounterCount; i++)
+    {
+        fprintf(out, "%-26s %llu\n", counter_names[i], (unsigned long long)total.counters[i]);
+    }
+    if (total.counters[InstrumentMovesGenerated] > 0)
+    {
+        fprintf(out, "%-26s %.1f%%\n", "rejection rate",
+                100.0 * total.counters[InstrumentMovesRejected] / total.counters[InstrumentMovesGenerated]);
+    }
+}
+
+void instrument_reset()
+{
+    pthread_mutex_lock(&blocks_lock);
+    for (counter_block *block = all_blocks; block != NULL; block = block->next)
+    {
+        counter_block *next = block->next;
+        memset(block, 0, sizeof(*block));
+        block->next = next;
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+static counter_block *get_block()
+{
+    if (thread_block != NULL)
+    {
+        return thread_block;
+    }
+
+    // Not counting is better than failing the caller, so without memory the counts go into a shared dummy block
+    static counter_block fallback;
+    counter_block *block = calloc(1, sizeof(counter_block));
+    if (block == NULL)
+    {
+        return &fallback;
+    }
+
+    pthread_mutex_lock(&blocks_lock);
+    if (all_blocks == NULL)
+    {
+        atexit(dump_at_exit);
+    }
+    block->next = all_blocks;
+    all_blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+
+    thread_block = block;
+    return block;
+}
+
+static uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void dump_at_exit()
+{
+    instrument_dump(stderr);
+}
+
+#else
+
+void instrument_dump(FILE *out)
+{
+    fprintf(out, "Instrumentation is not compiled in, build with make INSTRUMENT=1\n");
+}
+
+void instrument_reset()
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Call counts, inclusive time and event counters for the hot functions of the rules engine. Only compiled in when
+// CCHESS_INSTRUMENT is defined (make INSTRUMENT=1), otherwise the macros expand to nothing.
+// Every thread counts into its own block, the dump adds them up. Instrumented builds print the totals to stderr at exit
+
+typedef enum
+{
+    InstrumentGetValidMoves,
+    InstrumentGenerateLegalMoves,
+    InstrumentAddPseudoLegalMoves,
+    InstrumentIsSquareAttacked,
+    InstrumentIsInCheck,
+    InstrumentGetCheckInfo,
+    InstrumentIsLegalMove,
+    InstrumentHasLegalMove,
+    InstrumentMakeMove,
+    InstrumentUndoLastMove,
+    InstrumentCheckGameOver,
+    InstrumentRepetitionCount,
+    InstrumentImportFEN,
+    InstrumentExportFEN,
+    InstrumentMoveFromSAN,
+    InstrumentMoveToSAN,
+    InstrumentFunctionCount
+} instrument_function;
+
+typedef enum
+{
+    InstrumentMovesGenerated, // Pseudo-legal moves produced while generating legal moves
+    InstrumentMovesRejected,  // Of those, the ones that would leave the king in check
+    InstrumentCounterCount
+} instrument_counter;
+
+// Writes calls, total and average time per function and the counters
+void instrument_dump(FILE *out);
+
+// Zeroes all counts. Counts from threads that are running functions at the same time may survive
+void instrument_reset();
+
+#ifdef CCHESS_INSTRUMENT
+
+typedef struct
+{
+    instrument_function function;
+    uint64_t start;
+} instrument_scope;
+
+instrument_scope instrument_enter(instrument_function function);
+void instrument_leave(instrument_scope *scope);
+void instrument_add(instrument_counter counter, uint64_t amount);
+
+// First statement of a function. The time is taken when the scope variable goes out of scope, so early returns count
+#define INSTRUMENT_FUNCTION(function)                                                                                  \
+    instrument_scope instrument_scope_ __attribute__((cleanup(instrument_leave))) = instrument_enter(function)
+#define INSTRUMENT_COUNT(counter, amount) instrument_add((counter), (amount))
+
+#else
+
+#define INSTRUMENT_FUNCTION(function) ((void)0)
+#define INSTRUMENT_COUNT(counter, amount) ((void)(amount))
+
+#endif
+
+#endif
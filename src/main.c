@@ -1,13 +1,66 @@
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "raylib.h"
+#include "analysis.h"
+#include "assets.h"
 #include "chess.h"
+#include "optree.h"
+#include "posindex.h"
+#include "profiler.h"
+#include "review.h"
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 
-void get_piece_path(piece_type piece, char *path, size_t size);
-Texture2D get_piece_texture(piece_type piece);
+// Draw calls made by this file, counted for the profiler overlay. raylib only keeps the number of batches it flushes
+// inside rlgl, which isn't part of its public header, and raygui's own drawing happens inside raygui.h above
+static int frameDrawCalls = 0;
+#define DrawRectangle(...) (frameDrawCalls++, DrawRectangle(__VA_ARGS__))
+#define DrawText(...) (frameDrawCalls++, DrawText(__VA_ARGS__))
+#define DrawCircle(...) (frameDrawCalls++, DrawCircle(__VA_ARGS__))
+#define DrawTexturePro(...) (frameDrawCalls++, DrawTexturePro(__VA_ARGS__))
+#define DrawTextureRec(...) (frameDrawCalls++, DrawTextureRec(__VA_ARGS__))
+#define DrawLineEx(...) (frameDrawCalls++, DrawLineEx(__VA_ARGS__))
+#define DrawTriangle(...) (frameDrawCalls++, DrawTriangle(__VA_ARGS__))
+
+// Review of a finished game, shown in place of the game over message until it's closed
+typedef struct
+{
+    game played;      // The game as it ended
+    game scratch;     // Taken back to the moves being described
+    ply_review plies[MAX_MOVES];
+    uint done;        // Moves reviewed so far
+    char lines[MAX_MOVES][80]; // Description of each inaccuracy, mistake or blunder, empty until it's reviewed
+} game_review;
+
+// Piece atlas and sounds, decoded on a background thread so the first frames don't wait for them. Only the upload to
+// the GPU and the audio device is left to the main thread, raylib can't do that from another one
+typedef struct
+{
+    Image piece_atlas;
+    Rectangle piece_sources[12];
+    Wave move_wave;
+    Wave capture_wave;
+    Wave castle_wave;
+    atomic_bool ready; // Set once everything above is filled in
+} decoded_assets;
+
+void get_piece_asset_name(piece_type piece, char *name, size_t size);
+Image load_embedded_image(const char *name);
+Wave load_embedded_wave(const char *name);
+Image decode_piece_atlas(Rectangle sources[12]);
+void *decode_assets(void *assets);
+void render_board_background(RenderTexture2D target);
+void draw_board_background(RenderTexture2D target);
+void draw_profiler(const frame_profiler *profiler, const analysis_info *engine);
+void format_pv(const game *position, const move *pv, uint length, char *text, size_t size);
+void draw_eval_bar(int whiteScore);
+void draw_move_arrow(move m, Color color);
+void describe_review(game_review *review, uint ply, char *text, size_t size);
 
 const int CELL_SIZE = 110;
 const int BOARD_LABEL_WIDTH = 50; // Area where numbers and letters are (1-8, A-H)
@@ -18,41 +71,107 @@ const int MENU_BAR_HEIGHT = 60;
 const int SCREEN_WIDTH = CELL_SIZE * 8 + BOARD_LABEL_WIDTH;
 const int SCREEN_HEIGHT = MENU_BAR_HEIGHT + CELL_SIZE * 8 + BOARD_LABEL_WIDTH;
 const int BUTTON_HEIGHT = 60;
-const int BUTTON_WIDTH = SCREEN_WIDTH / 4;
+const int BUTTON_WIDTH = SCREEN_WIDTH / 5;
 const int ICON_BUTTON_HEIGHT = 60;
-const int ICON_BUTTON_WIDTH = SCREEN_WIDTH / 4 + 5;
+const int ICON_BUTTON_WIDTH = SCREEN_WIDTH / 5 + 5;
 const int NOTIFICATION_DURATION = 2000; // Duration in milliseconds
+const int EXPLORER_WIDTH = 340;          // Panel right of the board, only shown with --index or --tree
+const int EXPLORER_MAX_ROWS = 24;
+const int IDLE_EXTRA_FRAMES = 2; // Frames drawn after an event in idle mode, so changes made while handling it show up
+const int PROFILER_WIDTH = 430;
+const int ANALYSIS_HASH_MB = 64;
+const int ANALYSIS_LINES = 3;   // Best moves shown, up to SEARCH_MAX_PV
+const int ANALYSIS_WIDTH = 440; // Panel with the evaluations and lines right of the board and explorer, only while analysing
+const int EVAL_BAR_WIDTH = 12;  // In the rank label column
+const int PV_SAN_MOVES = 8;     // Moves of the principal variation shown as text
+const int REVIEW_DEPTH = 8;     // Per position of a reviewed game
+const int REVIEW_HASH_MB = 16;  // Per review thread
+const int REVIEW_WIDTH = 560;
+const int REVIEW_MAX_ROWS = 16;
+const char PIECE_GLYPHS[] = "prnbqkPRNBQK"; // Drawn in place of the pieces until their textures are loaded, by piece - 1
 
 const Color CELL_COLOR_1 = {150, 77, 34, 255};
 const Color CELL_COLOR_2 = {238, 220, 151, 255};
 const Color SIDEBAR_COLOR = {21, 10, 4, 255};
 const Color HIGHLIGHT_COLOR = {255, 255, 0, 200};
 const Color TEXT_BACKGROUND = {0, 0, 0, 200};
+const Color ARROW_COLOR = {0, 120, 255, 170}; // Best move, the other lines are fainter
 
-int main()
+int main(int argc, char **argv)
 {
+    // Optional position index (see cchess-index) and opening tree (see cchess-tree) for the explorer panel
+    posindex *explorer = NULL;
+    optree *openingTree = NULL;
+    bool idleMode = false; // --idle: only redraw on input and while something is changing on screen
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--idle") == 0)
+        {
+            idleMode = true;
+        }
+        else if (i + 1 == argc)
+        {
+            break;
+        }
+        else if (strcmp(argv[i], "--index") == 0)
+        {
+            explorer = posindex_open(argv[++i]);
+            if (explorer == NULL)
+            {
+                printf("Could not open position index %s\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--tree") == 0)
+        {
+            openingTree = optree_open(argv[++i]);
+            if (openingTree == NULL)
+            {
+                printf("Could not open opening tree %s\n", argv[i]);
+            }
+        }
+    }
+
+    bool showExplorer = explorer != NULL || openingTree != NULL;
+    int windowWidth = SCREEN_WIDTH + (showExplorer ? EXPLORER_WIDTH : 0); // Widened by ANALYSIS_WIDTH while analysing
+
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Chess");
+    InitWindow(windowWidth, SCREEN_HEIGHT, "Chess");
     InitAudioDevice();
     SetTargetFPS(60);
 
     game g = init_game();
 
-    // Load textures
-    Texture2D textures[12];
-    for (int i = 0; i < 12; i++)
+    // Squares and labels never change while the game runs, so they're drawn once into a texture that covers everything
+    // below the menu bar and only drawn again when the window is resized
+    RenderTexture2D boardBackground = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT - MENU_BAR_HEIGHT);
+    render_board_background(boardBackground);
+
+    // All pieces live in one texture, so drawing a full board doesn't switch textures and raylib can batch it. Until
+    // the loader is done pieces are drawn as letters and moves make no sound, playing an unloaded sound does nothing
+    decoded_assets decodedAssets = {0};
+    atomic_init(&decodedAssets.ready, false);
+    pthread_t assetLoader;
+    bool assetLoaderRunning = pthread_create(&assetLoader, NULL, decode_assets, &decodedAssets) == 0;
+    if (!assetLoaderRunning)
     {
-        textures[i] = get_piece_texture(i + 1);
+        decode_assets(&decodedAssets);
     }
 
-    // Load sounds
-    Sound moveSound = LoadSound("assets/move.wav");
-    Sound captureSound = LoadSound("assets/capture.wav");
-    Sound castleSound = LoadSound("assets/castle.wav");
+    bool assetsLoaded = false;
+    Rectangle pieceSources[12];
+    Texture2D pieceAtlas = {0};
+    Sound moveSound = {0};
+    Sound captureSound = {0};
+    Sound castleSound = {0};
 
     int selectedSquare = -1;
     move_list validMoves = {.moves = {}, .count = 0};
 
+    // Legal moves of the selected piece, generated again only when the selection or the position changes. The hash
+    // changes with every move, undo, import and reset, and equal hashes mean the same moves are legal
+    int validMovesSquare = -1;
+    uint64_t validMovesHash = 0;
+
     double gameOverTimer = 0;
     double notificationTimer = 0;
     bool showNotification = false;
@@ -67,14 +186,76 @@ int main()
     piece_type promotionChoicesBlack[] = {BlackQueen, BlackRook, BlackBishop, BlackKnight};
     bool showPromotionDialog = false;
     piece_color promotionColor = CChessWhite;
-    int promotionX = -1;
-    int promotionY = -1;
+    move pendingPromotion = {0};
     int selectedPromotionOption = -1;
 
+    // Explorer results only change with the position, so they're looked up again only when the hash differs
+    posindex_move_stat explorerMoves[EXPLORER_MAX_ROWS];
+    uint explorerMoveCount = 0;
+    uint64_t explorerGames = 0;
+    optree_child treeMoves[OPTREE_MAX_CHILDREN];
+    uint treeMoveCount = 0;
+    uint64_t explorerHash = 0;
+    bool explorerValid = false;
+
     GuiSetStyle(DEFAULT, TEXT_SIZE, FONT_SIZE);
 
+    int activeFrames = 0; // Idle mode: frames left before waiting for events again
+
+    // Analysis runs on its own thread with a search context that is created on the first click and kept, so its
+    // transposition table survives moves, undos and imports. The position is handed over whenever the hash changes
+    analysis *engine = NULL;
+    bool analyzing = false;
+    uint64_t analysisHash = 0;
+    analysis_info analysisInfo = {0};
+    char pvText[SEARCH_MAX_PV][PV_SAN_MOVES * 8];
+    uint64_t pvTextNodes = 0; // Search the text was made for, it's only converted to SAN once per iteration
+
+    // Review of the last finished game on a thread pool, started from the game over message. The threads are created
+    // on the first review and kept. The board is left on the final position until the review is closed
+    reviewer *gameReviewer = NULL;
+    game_review *review = NULL;
+    bool reviewing = false;
+    uint64_t reviewHash = 0;
+
+    // F3 shows the profiler overlay. Samples are taken all the time, so it has data as soon as it opens
+    frame_profiler *profiler = calloc(1, sizeof(frame_profiler));
+    bool showProfiler = false;
+    double lastFrameStart = GetTime();
+
     while (!WindowShouldClose())
     {
+        double frameStart = GetTime();
+        frame_sample frame = {.frame_time = frameStart - lastFrameStart};
+        lastFrameStart = frameStart;
+        frameDrawCalls = 0;
+
+        if (IsKeyPressed(KEY_F3))
+        {
+            showProfiler = !showProfiler;
+        }
+
+        if (!assetsLoaded && atomic_load(&decodedAssets.ready))
+        {
+            if (assetLoaderRunning)
+            {
+                pthread_join(assetLoader, NULL);
+                assetLoaderRunning = false;
+            }
+
+            pieceAtlas = LoadTextureFromImage(decodedAssets.piece_atlas);
+            memcpy(pieceSources, decodedAssets.piece_sources, sizeof(pieceSources));
+            moveSound = LoadSoundFromWave(decodedAssets.move_wave);
+            captureSound = LoadSoundFromWave(decodedAssets.capture_wave);
+            castleSound = LoadSoundFromWave(decodedAssets.castle_wave);
+
+            UnloadImage(decodedAssets.piece_atlas);
+            UnloadWave(decodedAssets.move_wave);
+            UnloadWave(decodedAssets.capture_wave);
+            UnloadWave(decodedAssets.castle_wave);
+            assetsLoaded = true;
+        }
+
         if (g.status == WhiteWon)
         {
             SetWindowTitle("Chess - White Won!");
@@ -83,7 +264,7 @@ int main()
         {
             SetWindowTitle("Chess - Black Won!");
         }
-        else if (g.status == Stalemate)
+        else if (g.status != InProgress)
         {
             SetWindowTitle("Chess - Draw!");
         }
@@ -97,55 +278,47 @@ int main()
             SetWindowTitle("Chess - Black's Turn");
         }
 
-        BeginDrawing();
-
-        ClearBackground(SIDEBAR_COLOR);
+        if (IsWindowResized())
+        {
+            render_board_background(boardBackground);
+        }
 
-        // Draw board
-        for (int y = 0; y < 8; y++)
+        if (analyzing)
         {
-            for (int x = 0; x < 8; x++)
+            if (g.hash != analysisHash)
             {
-                // Draw selected square
-                if (selectedSquare != -1 &&
-                    y == selectedSquare / 8 &&
-                    x == selectedSquare % 8)
-                {
-                    DrawRectangle(
-                        BOARD_LABEL_WIDTH + x * CELL_SIZE,
-                        MENU_BAR_HEIGHT + y * CELL_SIZE,
-                        CELL_SIZE,
-                        CELL_SIZE,
-                        HIGHLIGHT_COLOR);
-
-                    continue;
-                }
-
-                if ((y + x) % 2 == 0)
-                {
-                    DrawRectangle(BOARD_LABEL_WIDTH + x * CELL_SIZE, MENU_BAR_HEIGHT + y * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_COLOR_1);
-                }
-                else
-                {
-                    DrawRectangle(BOARD_LABEL_WIDTH + x * CELL_SIZE, MENU_BAR_HEIGHT + y * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_COLOR_2);
-                }
+                analysis_set_position(engine, &g);
+                analysisHash = g.hash;
             }
+            analysis_poll(engine, &analysisInfo);
         }
+        bool showAnalysis = analyzing && analysisInfo.has_result && analysisInfo.hash == g.hash;
 
-        // Draw numbers
-        for (int i = 0; i < 8; i++)
+        // Undo, import and reset end the review, it belongs to the final position
+        if (reviewing && g.hash != reviewHash)
+        {
+            review_stop(gameReviewer);
+            reviewing = false;
+        }
+        if (reviewing)
         {
-            char num[2]; // 1 byte for char itself, 1 for string termination char
-            snprintf(num, sizeof(num), "%d", 8 - i);
-            DrawText(num, PADDING, MENU_BAR_HEIGHT + i * CELL_SIZE + CELL_SIZE / 2, FONT_SIZE, WHITE);
+            review_poll(gameReviewer, review->plies, &review->done);
         }
 
-        // Draw letters
-        for (int i = 0; i < 8; i++)
+        BeginDrawing();
+
+        ClearBackground(SIDEBAR_COLOR);
+
+        // Draw board
+        draw_board_background(boardBackground);
+
+        // Draw selected square, the translucent highlight goes over the background color rather than the square
+        if (selectedSquare != -1)
         {
-            char letter[2];
-            snprintf(letter, sizeof(letter), "%c", 'A' + i);
-            DrawText(letter, BOARD_LABEL_WIDTH + CELL_SIZE / 2 + i * CELL_SIZE - 10, SCREEN_HEIGHT - 2.3 * PADDING, FONT_SIZE, WHITE);
+            int x = BOARD_LABEL_WIDTH + (selectedSquare % 8) * CELL_SIZE;
+            int y = MENU_BAR_HEIGHT + (selectedSquare / 8) * CELL_SIZE;
+            DrawRectangle(x, y, CELL_SIZE, CELL_SIZE, SIDEBAR_COLOR);
+            DrawRectangle(x, y, CELL_SIZE, CELL_SIZE, HIGHLIGHT_COLOR);
         }
 
         // Draw pieces
@@ -158,13 +331,17 @@ int main()
                     continue;
                 }
 
-                Texture2D texture = textures[g.board[row][col] - 1];
+                if (!assetsLoaded)
+                {
+                    char glyph[2] = {PIECE_GLYPHS[g.board[row][col] - 1], '\0'};
+                    Color glyphColor = (get_piece_color(g.board[row][col]) == CChessWhite) ? WHITE : BLACK;
+                    int glyphSize = CELL_SIZE / 2;
+                    DrawText(glyph, BOARD_LABEL_WIDTH + col * CELL_SIZE + (CELL_SIZE - MeasureText(glyph, glyphSize)) / 2,
+                             MENU_BAR_HEIGHT + row * CELL_SIZE + (CELL_SIZE - glyphSize) / 2, glyphSize, glyphColor);
+                    continue;
+                }
 
-                Rectangle pieceRectangle = {
-                    0,
-                    0,
-                    texture.width,
-                    texture.height};
+                Rectangle pieceRectangle = pieceSources[g.board[row][col] - 1];
 
                 Rectangle pieceDestRectangle = {
                     BOARD_LABEL_WIDTH + col * CELL_SIZE + CELL_SIZE / 2,
@@ -172,19 +349,75 @@ int main()
                     pieceRectangle.width,
                     pieceRectangle.height};
 
-                Vector2 pieceCenter = {texture.width / 2, texture.height / 2};
+                Vector2 pieceCenter = {pieceRectangle.width / 2, pieceRectangle.height / 2};
 
-                DrawTexturePro(texture, pieceRectangle, pieceDestRectangle, pieceCenter, 0, WHITE);
+                DrawTexturePro(pieceAtlas, pieceRectangle, pieceDestRectangle, pieceCenter, 0, WHITE);
             }
         }
 
-        // Draw possible moves
-        if (selectedSquare != -1)
+        // Draw analysis: evaluation bar, an arrow per line with the best one on top, and the lines as text
+        if (showAnalysis)
+        {
+            const search_result *result = &analysisInfo.result;
+            int sign = (g.current_turn == CChessWhite) ? 1 : -1;
+            draw_eval_bar(sign * result->score);
+
+            for (int l = (int)result->line_count - 1; l >= 0; l--)
+            {
+                if (result->lines[l].pv_length > 0)
+                {
+                    Color color = ARROW_COLOR;
+                    color.a = (unsigned char)(ARROW_COLOR.a / (l + 1));
+                    draw_move_arrow(result->lines[l].pv[0], color);
+                }
+            }
+
+            if (pvTextNodes != result->nodes)
+            {
+                for (uint l = 0; l < result->line_count; l++)
+                {
+                    format_pv(&g, result->lines[l].pv, result->lines[l].pv_length, pvText[l], sizeof(pvText[l]));
+                }
+                pvTextNodes = result->nodes;
+            }
+
+            // Side panel, so nothing on the board is covered
+            char score[16];
+            char line[96];
+            int lineHeight = FONT_SIZE * 3 / 4 + PADDING / 2;
+            int panelX = windowWidth + PADDING;
+            int panelY = MENU_BAR_HEIGHT;
+
+            review_format_score(sign * result->score, score, sizeof(score));
+            snprintf(line, sizeof(line), "%s  depth %d/%d  %.0f knps", score, result->depth, result->seldepth,
+                     analysisInfo.nps / 1000.0);
+            DrawText(line, panelX, panelY, FONT_SIZE, WHITE);
+
+            for (uint l = 0; l < result->line_count; l++)
+            {
+                int lineY = panelY + FONT_SIZE * 2 + l * lineHeight;
+                review_format_score(sign * result->lines[l].score, score, sizeof(score));
+                DrawText(score, panelX, lineY, FONT_SIZE * 3 / 4, WHITE);
+                DrawText(pvText[l], panelX + 60, lineY, FONT_SIZE * 3 / 4, WHITE);
+            }
+        }
+        else if (analyzing)
         {
-            int x = selectedSquare % 8;
-            int y = selectedSquare / 8;
+            DrawText("Searching...", windowWidth + PADDING, MENU_BAR_HEIGHT, FONT_SIZE, WHITE);
+        }
 
-            validMoves = get_valid_moves(&g, x, y);
+        // Draw possible moves, the click handler below uses the same list
+        if (selectedSquare != -1)
+        {
+            if (selectedSquare != validMovesSquare || g.hash != validMovesHash)
+            {
+                double start = GetTime();
+                validMoves = get_valid_moves(&g, selectedSquare % 8, selectedSquare / 8);
+                frame.valid_moves_time += GetTime() - start;
+                frame.valid_moves_calls++;
+                validMovesSquare = selectedSquare;
+                validMovesHash = g.hash;
+            }
 
             for (uint i = 0; i < validMoves.count; i++)
             {
@@ -194,6 +427,8 @@ int main()
             }
         }
 
+        bool positionChanged = false;
+
         if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && g.status == InProgress && !showPromotionDialog)
         {
             Vector2 position = GetMousePosition();
@@ -211,47 +446,33 @@ int main()
                         move m = validMoves.moves[i];
                         if (m.x_to == x_clicked && m.y_to == y_clicked)
                         {
-                            promotionColor = g.current_turn;
-
-                            move_result result = make_move(&g, m);
-                            if (result == None)
+                            if (m.promotion_piece != EMPTY)
                             {
-                                PlaySound(moveSound);
-                            }
-                            else if (result == PieceCaptured)
-                            {
-                                PlaySound(captureSound);
-                            }
-                            else if (result == Castle)
-                            {
-                                PlaySound(castleSound);
+                                // The move is only made once a piece has been picked in the dialog
+                                pendingPromotion = m;
+                                promotionColor = g.current_turn;
+                                showPromotionDialog = true;
                             }
-                            else if (result == Promotion)
+                            else
                             {
-                                // Store the location of the pawn that needs promotion
-                                promotionX = m.x_to;
-                                promotionY = m.y_to;
-                                showPromotionDialog = true;
-
-                                PlaySound(moveSound);
+                                move_result result = make_move(&g, m);
+                                if (result == None)
+                                {
+                                    PlaySound(moveSound);
+                                }
+                                else if (result == PieceCaptured)
+                                {
+                                    PlaySound(captureSound);
+                                }
+                                else if (result == Castle)
+                                {
+                                    PlaySound(castleSound);
+                                }
+                                positionChanged = true;
                             }
 
                             selectedSquare = -1;
                             move_made = true;
-
-                            game_status status = check_game_over(&g);
-                            if (status == WhiteWon)
-                            {
-                                g.status = WhiteWon;
-                                gameOverTimer = GetTime();
-                                printf("White Won!\n");
-                            }
-                            else if (status == BlackWon)
-                            {
-                                g.status = BlackWon;
-                                gameOverTimer = GetTime();
-                                printf("Black Won!\n");
-                            }
                             break;
                         }
                     }
@@ -293,10 +514,81 @@ int main()
             printf("Piece on that square: %d\n", g.board[y_clicked][x_clicked]);
         }
 
-        // Draw game over message
-        if (g.status == WhiteWon || g.status == BlackWon)
+        if (positionChanged)
+        {
+            double start = GetTime();
+            game_status status = check_game_over(&g);
+            frame.game_over_time += GetTime() - start;
+            frame.game_over_calls++;
+            if (status != InProgress)
+            {
+                g.status = status;
+                gameOverTimer = GetTime();
+                printf("Game over: %d\n", status);
+            }
+        }
+
+        // Draw game over message, or the review of the game once it's asked for
+        if (reviewing)
+        {
+            int boxX = BOARD_LABEL_WIDTH + (CELL_SIZE * 8 - REVIEW_WIDTH) / 2;
+            int boxY = MENU_BAR_HEIGHT + PADDING;
+            int lineHeight = FONT_SIZE * 3 / 4 + PADDING / 2;
+            int rowY = boxY + PADDING + FONT_SIZE * 2;
+            uint plies = review->played.move_history.count;
+            DrawRectangle(boxX, boxY, REVIEW_WIDTH, FONT_SIZE * 3 + PADDING * 3 + lineHeight * (REVIEW_MAX_ROWS + 1),
+                          TEXT_BACKGROUND);
+
+            char title[64];
+            snprintf(title, sizeof(title), "Game review: %u/%u moves", review->done, plies);
+            DrawText(title, boxX + PADDING, boxY + PADDING, FONT_SIZE, WHITE);
+
+            // Inaccuracies, mistakes and blunders in game order, as far as the review has got
+            int rows = 0;
+            int hidden = 0;
+            for (uint i = 0; i < plies; i++)
+            {
+                if (!review->plies[i].done || review->plies[i].grade == ReviewGood)
+                {
+                    continue;
+                }
+                if (rows == REVIEW_MAX_ROWS)
+                {
+                    hidden++;
+                    continue;
+                }
+                if (review->lines[i][0] == '\0')
+                {
+                    describe_review(review, i, review->lines[i], sizeof(review->lines[i]));
+                }
+                DrawText(review->lines[i], boxX + PADDING, rowY + rows * lineHeight, FONT_SIZE * 3 / 4, WHITE);
+                rows++;
+            }
+            if (hidden > 0)
+            {
+                char more[32];
+                snprintf(more, sizeof(more), "and %d more", hidden);
+                DrawText(more, boxX + PADDING, rowY + rows * lineHeight, FONT_SIZE * 3 / 4, WHITE);
+            }
+            else if (rows == 0 && review->done == plies)
+            {
+                DrawText("No inaccuracies", boxX + PADDING, rowY, FONT_SIZE * 3 / 4, WHITE);
+            }
+
+            Rectangle closeBtn = {boxX + REVIEW_WIDTH - 120 - PADDING, boxY + PADDING / 2, 120, FONT_SIZE + PADDING};
+            if (GuiButton(closeBtn, "Close") && !showPromotionDialog)
+            {
+                review_stop(gameReviewer);
+                reviewing = false;
+                reset_game(&g);
+            }
+        }
+        else if (g.status != InProgress)
         {
-            if ((GetTime() - gameOverTimer) * 1000 > GAME_OVER_TIME)
+            // A game with moves waits for "New game" or "Analyze game", only one set up already finished goes away
+            // by itself
+            bool reviewable = g.move_history.count > 0;
+            if (!reviewable && (GetTime() - gameOverTimer) * 1000 > GAME_OVER_TIME)
             {
                 reset_game(&g);
             }
@@ -307,7 +599,7 @@ int main()
                 {
                     winner_text = "Black Wins!";
                 }
-                else if (g.status == Stalemate)
+                else if (g.status != WhiteWon)
                 {
                     winner_text = "Draw!";
                 }
@@ -326,6 +618,103 @@ int main()
                 int textX = SCREEN_WIDTH / 2 - textWidth / 2;
                 int textY = SCREEN_HEIGHT / 2 - textHeight / 2;
                 DrawText(winner_text, textX, textY, messageFontSize, WHITE);
+
+                Rectangle newGameBtn = {SCREEN_WIDTH / 2 - BUTTON_WIDTH - 5, boxY + boxHeight + 10, BUTTON_WIDTH,
+                                        BUTTON_HEIGHT};
+                Rectangle reviewBtn = {SCREEN_WIDTH / 2 + 5, boxY + boxHeight + 10, BUTTON_WIDTH, BUTTON_HEIGHT};
+                if (reviewable && GuiButton(newGameBtn, "New game") && !showPromotionDialog)
+                {
+                    reset_game(&g);
+                    selectedSquare = -1;
+                }
+                else if (reviewable && GuiButton(reviewBtn, "Analyze game") && !showPromotionDialog)
+                {
+                    if (gameReviewer == NULL)
+                    {
+                        review_options options = {.depth = REVIEW_DEPTH, .hash_megabytes = REVIEW_HASH_MB};
+                        gameReviewer = review_create(&options);
+                    }
+                    if (review == NULL)
+                    {
+                        review = malloc(sizeof(game_review));
+                    }
+
+                    if (gameReviewer == NULL || review == NULL)
+                    {
+                        notificationText = "Could not start the review!";
+                        notificationTimer = GetTime();
+                        showNotification = true;
+                    }
+                    else
+                    {
+                        review->played = g;
+                        review->done = 0;
+                        memset(review->plies, 0, sizeof(review->plies));
+                        memset(review->lines, 0, sizeof(review->lines));
+                        review_start(gameReviewer, &g);
+                        reviewing = true;
+                        reviewHash = g.hash;
+                    }
+                }
+            }
+        }
+
+        // Draw opening explorer
+        if (showExplorer)
+        {
+            if (!explorerValid || explorerHash != g.hash)
+            {
+                if (explorer != NULL)
+                {
+                    const posindex_entry *entries;
+                    explorerGames = posindex_find(explorer, g.hash, &entries);
+                    explorerMoveCount = posindex_next_moves(explorer, g.hash, explorerMoves, EXPLORER_MAX_ROWS);
+                }
+                if (openingTree != NULL)
+                {
+                    treeMoveCount = optree_children(openingTree, &g, treeMoves, OPTREE_MAX_CHILDREN);
+                }
+                explorerHash = g.hash;
+                explorerValid = true;
+            }
+
+            int panelX = SCREEN_WIDTH + PADDING;
+            int rowY = MENU_BAR_HEIGHT;
+            char line[64];
+
+            if (explorer != NULL)
+            {
+                snprintf(line, sizeof(line), "Games: %llu", (unsigned long long)explorerGames);
+                DrawText(line, panelX, rowY, FONT_SIZE, WHITE);
+                rowY += FONT_SIZE * 2;
+
+                for (uint i = 0; i < explorerMoveCount; i++)
+                {
+                    char san[16];
+                    move_to_SAN(&g, gamedb_unpack_move(&g, explorerMoves[i].move), san);
+                    snprintf(line, sizeof(line), "%-8s %u", san, explorerMoves[i].count);
+                    DrawText(line, panelX, rowY, FONT_SIZE, WHITE);
+                    rowY += FONT_SIZE + PADDING / 2;
+                }
+                rowY += FONT_SIZE;
+            }
+
+            if (openingTree != NULL)
+            {
+                DrawText("Opening tree (W/D/L %)", panelX, rowY, FONT_SIZE, WHITE);
+                rowY += FONT_SIZE * 2;
+
+                for (uint i = 0; i < treeMoveCount && rowY < SCREEN_HEIGHT - FONT_SIZE; i++)
+                {
+                    char san[16];
+                    const optree_node *stats = &treeMoves[i].stats;
+                    move_to_SAN(&g, treeMoves[i].move, san);
+                    snprintf(line, sizeof(line), "%-7s %6u  %2u/%2u/%2u", san, stats->games,
+                             100 * stats->white_wins / stats->games, 100 * stats->draws / stats->games,
+                             100 * stats->black_wins / stats->games);
+                    DrawText(line, panelX, rowY, FONT_SIZE, WHITE);
+                    rowY += FONT_SIZE + PADDING / 2;
+                }
             }
         }
 
@@ -363,6 +752,42 @@ int main()
         {
             undo_last_move(&g);
             selectedSquare = -1;
+
+            // Taking back the last move of a finished game puts it back in play, so check the position again
+            double start = GetTime();
+            g.status = check_game_over(&g);
+            frame.game_over_time += GetTime() - start;
+            frame.game_over_calls++;
+        }
+
+        Rectangle analyzeBtn = (Rectangle){undoBtn.x + undoBtn.width,
+                                           0, BUTTON_WIDTH, BUTTON_HEIGHT};
+        if (GuiButton(analyzeBtn, analyzing ? "Stop Analysis" : "Analyze") && !showPromotionDialog)
+        {
+            if (engine == NULL)
+            {
+                engine = analysis_create(ANALYSIS_HASH_MB, ANALYSIS_LINES);
+            }
+
+            if (engine == NULL)
+            {
+                notificationText = "Could not start the analysis!";
+                notificationTimer = GetTime();
+                showNotification = true;
+            }
+            else if (analyzing)
+            {
+                analysis_stop(engine);
+                analyzing = false;
+                SetWindowSize(windowWidth, SCREEN_HEIGHT);
+            }
+            else
+            {
+                analysis_set_position(engine, &g);
+                analysisHash = g.hash;
+                analyzing = true;
+                SetWindowSize(windowWidth + ANALYSIS_WIDTH, SCREEN_HEIGHT);
+            }
         }
 
         // Rectangle redoBtn = (Rectangle){undoBtn.x + undoBtn.width,
@@ -497,28 +922,84 @@ int main()
             {
                 if (promotionColor == CChessWhite)
                 {
-                    g.board[promotionY][promotionX] = promotionChoicesWhite[selectedPromotionOption];
+                    pendingPromotion.promotion_piece = promotionChoicesWhite[selectedPromotionOption];
                 }
                 else
                 {
-                    g.board[promotionY][promotionX] = promotionChoicesBlack[selectedPromotionOption];
+                    pendingPromotion.promotion_piece = promotionChoicesBlack[selectedPromotionOption];
                 }
 
+                make_move(&g, pendingPromotion);
+                PlaySound(pendingPromotion.destination_piece != EMPTY ? captureSound : moveSound);
+
                 showPromotionDialog = false;
                 selectedPromotionOption = -1;
-                promotionX = promotionY = -1;
+
+                // The dialog is drawn after the game over check, so evaluate the new position right here
+                double start = GetTime();
+                game_status status = check_game_over(&g);
+                frame.game_over_time += GetTime() - start;
+                frame.game_over_calls++;
+                if (status != InProgress)
+                {
+                    g.status = status;
+                    gameOverTimer = GetTime();
+                    printf("Game over: %d\n", status);
+                }
+            }
+        }
+
+        // Drawn last so it covers everything else, its own draw calls are part of the frame too
+        if (showProfiler && profiler != NULL)
+        {
+            draw_profiler(profiler, analyzing ? &analysisInfo : NULL);
+        }
+
+        frame.work_time = GetTime() - frameStart;
+        frame.draw_calls = frameDrawCalls;
+        if (profiler != NULL)
+        {
+            profiler_add(profiler, &frame);
+        }
+
+        // In idle mode EndDrawing sleeps until the next input event, unless a timer is running on screen
+        if (idleMode)
+        {
+            bool gameOverCountdown = g.status != InProgress && !reviewing && g.move_history.count == 0;
+            bool timerRunning = showNotification || gameOverCountdown || !assetsLoaded || analyzing ||
+                                (reviewing && review->done < review->played.move_history.count);
+            if (timerRunning || activeFrames > 0)
+            {
+                DisableEventWaiting();
+                activeFrames = timerRunning ? activeFrames : activeFrames - 1;
+            }
+            else
+            {
+                EnableEventWaiting();
+                activeFrames = IDLE_EXTRA_FRAMES; // Used up after the event that ends the wait
             }
         }
 
         EndDrawing();
     }
 
-    // Unload textures
-    for (int i = 0; i < 12; i++)
+    // Closed before the loader was done, what it decoded was never uploaded
+    if (!assetsLoaded)
     {
-        UnloadTexture(textures[i]);
+        if (assetLoaderRunning)
+        {
+            pthread_join(assetLoader, NULL);
+        }
+        UnloadImage(decodedAssets.piece_atlas);
+        UnloadWave(decodedAssets.move_wave);
+        UnloadWave(decodedAssets.capture_wave);
+        UnloadWave(decodedAssets.castle_wave);
     }
 
+    // Unload textures
+    UnloadTexture(pieceAtlas);
+    UnloadRenderTexture(boardBackground);
+
     // Unload sounds
     UnloadSound(moveSound);
     UnloadSound(captureSound);
@@ -526,23 +1007,299 @@ int main()
 
     CloseAudioDevice();
 
+    analysis_destroy(engine);
+    review_destroy(gameReviewer);
+    free(review);
+    posindex_close(explorer);
+    optree_close(openingTree);
+    free(profiler);
+
     CloseWindow();
     return 0;
 }
 
-void get_piece_path(piece_type piece, char *path, size_t size)
+void get_piece_asset_name(piece_type piece, char *name, size_t size)
+{
+    snprintf(name, size, "highres/%s.png", piece_strings[piece]);
+}
+
+// Decodes an image compiled into the binary, see assets.h. An empty image if there is none by that name
+Image load_embedded_image(const char *name)
+{
+    const embedded_asset *asset = find_asset(name);
+    if (asset == NULL)
+    {
+        printf("Missing embedded asset %s\n", name);
+        return (Image){0};
+    }
+    return LoadImageFromMemory(GetFileExtension(name), asset->data, asset->size);
+}
+
+// Samples of a sound compiled into the binary. An empty wave if there is none by that name
+Wave load_embedded_wave(const char *name)
+{
+    const embedded_asset *asset = find_asset(name);
+    if (asset == NULL)
+    {
+        printf("Missing embedded asset %s\n", name);
+        return (Wave){0};
+    }
+    return LoadWaveFromMemory(GetFileExtension(name), asset->data, asset->size);
+}
+
+// Decodes the 12 piece images into one image in two rows of six, sources gets where each piece is, indexed by piece - 1.
+// Doesn't touch the GPU, so it can run on any thread
+Image decode_piece_atlas(Rectangle sources[12])
+{
+    Image images[12];
+    int cellSize = 0;
+    for (int i = 0; i < 12; i++)
+    {
+        char name[64];
+        get_piece_asset_name(i + 1, name, sizeof(name));
+        images[i] = load_embedded_image(name);
+        ImageFormat(&images[i], PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+        cellSize = (images[i].width > cellSize) ? images[i].width : cellSize;
+        cellSize = (images[i].height > cellSize) ? images[i].height : cellSize;
+    }
+
+    Image atlas = GenImageColor(6 * cellSize, 2 * cellSize, BLANK);
+    for (int i = 0; i < 12; i++)
+    {
+        // A piece that failed to load keeps an empty cell
+        sources[i] = (Rectangle){(i % 6) * cellSize, (i / 6) * cellSize, images[i].width, images[i].height};
+        Rectangle imageRectangle = {0, 0, images[i].width, images[i].height};
+        ImageDraw(&atlas, images[i], imageRectangle, sources[i], WHITE);
+        UnloadImage(images[i]);
+    }
+
+    return atlas;
+}
+
+// Thread function filling a decoded_assets, the main thread uploads them once ready is set
+void *decode_assets(void *assets)
+{
+    decoded_assets *decoded = assets;
+    decoded->piece_atlas = decode_piece_atlas(decoded->piece_sources);
+    decoded->move_wave = load_embedded_wave("move.wav");
+    decoded->capture_wave = load_embedded_wave("capture.wav");
+    decoded->castle_wave = load_embedded_wave("castle.wav");
+    atomic_store(&decoded->ready, true);
+    return NULL;
+}
+
+// Squares and rank and file labels, drawn into the texture with the menu bar height taken off every y coordinate
+void render_board_background(RenderTexture2D target)
+{
+    BeginTextureMode(target);
+    ClearBackground(SIDEBAR_COLOR);
+
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            Color color = ((y + x) % 2 == 0) ? CELL_COLOR_1 : CELL_COLOR_2;
+            DrawRectangle(BOARD_LABEL_WIDTH + x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE, color);
+        }
+    }
+
+    // Draw numbers
+    for (int i = 0; i < 8; i++)
+    {
+        char num[2]; // 1 byte for char itself, 1 for string termination char
+        snprintf(num, sizeof(num), "%d", 8 - i);
+        DrawText(num, PADDING, i * CELL_SIZE + CELL_SIZE / 2, FONT_SIZE, WHITE);
+    }
+
+    // Draw letters
+    for (int i = 0; i < 8; i++)
+    {
+        char letter[2];
+        snprintf(letter, sizeof(letter), "%c", 'A' + i);
+        DrawText(letter, BOARD_LABEL_WIDTH + CELL_SIZE / 2 + i * CELL_SIZE - 10, SCREEN_HEIGHT - MENU_BAR_HEIGHT - 2.3 * PADDING,
+                 FONT_SIZE, WHITE);
+    }
+
+    EndTextureMode();
+}
+
+void draw_board_background(RenderTexture2D target)
+{
+    // Render textures are stored upside down, a negative source height flips them back
+    Rectangle source = {0, 0, target.texture.width, -target.texture.height};
+    DrawTextureRec(target.texture, source, (Vector2){0, MENU_BAR_HEIGHT}, WHITE);
+}
+
+// Box in the top left corner of the board. The default font isn't monospaced, so every column has a fixed x.
+// engine is NULL while nothing is being analysed
+void draw_profiler(const frame_profiler *profiler, const analysis_info *engine)
+{
+    profiler_summary summary = profiler_summarize(profiler);
+    const int fontSize = FONT_SIZE / 2 + 2;
+    const int lineHeight = fontSize + 4;
+    const int labelWidth = 150;
+    const int columnWidth = (PROFILER_WIDTH - labelWidth - PADDING) / 4;
+    int x = BOARD_LABEL_WIDTH + PADDING / 2;
+    int y = MENU_BAR_HEIGHT + PADDING / 2;
+    char text[32];
+
+    DrawRectangle(x, y, PROFILER_WIDTH, lineHeight * (engine != NULL ? 11 : 8) + PADDING, TEXT_BACKGROUND);
+    x += PADDING / 2;
+    y += PADDING / 2;
+
+    const char *percentileHeaders[] = {"p50", "p90", "p99", "max"};
+    snprintf(text, sizeof(text), "Last %d frames", summary.frames);
+    DrawText(text, x, y, fontSize, WHITE);
+    for (int i = 0; i < 4; i++)
+    {
+        DrawText(percentileHeaders[i], x + labelWidth + i * columnWidth, y, fontSize, WHITE);
+    }
+    y += lineHeight;
+
+    const char *rowLabels[] = {"Frame time ms", "Work ms", "Draw calls"};
+    const profiler_percentiles *rows[] = {&summary.frame_time, &summary.work_time, &summary.draw_calls};
+    for (int row = 0; row < 3; row++)
+    {
+        double scale = (row < 2) ? 1000 : 1;
+        int decimals = (row < 2) ? 2 : 0;
+        double values[] = {rows[row]->p50, rows[row]->p90, rows[row]->p99, rows[row]->max};
+
+        DrawText(rowLabels[row], x, y, fontSize, WHITE);
+        for (int i = 0; i < 4; i++)
+        {
+            snprintf(text, sizeof(text), "%.*f", decimals, values[i] * scale);
+            DrawText(text, x + labelWidth + i * columnWidth, y, fontSize, WHITE);
+        }
+        y += lineHeight;
+    }
+    y += lineHeight;
+
+    // Calls over the window, average per call and the most spent in one frame
+    const char *callHeaders[] = {"calls", "us/call", "max us"};
+    for (int i = 0; i < 3; i++)
+    {
+        DrawText(callHeaders[i], x + labelWidth + i * columnWidth, y, fontSize, WHITE);
+    }
+    y += lineHeight;
+
+    const char *functionNames[] = {"get_valid_moves", "check_game_over"};
+    double calls[] = {summary.valid_moves_calls, summary.game_over_calls};
+    double means[] = {summary.valid_moves_mean, summary.game_over_mean};
+    double maxima[] = {summary.valid_moves_max, summary.game_over_max};
+    for (int row = 0; row < 2; row++)
+    {
+        DrawText(functionNames[row], x, y, fontSize, WHITE);
+        snprintf(text, sizeof(text), "%.0f", calls[row]);
+        DrawText(text, x + labelWidth, y, fontSize, WHITE);
+        snprintf(text, sizeof(text), "%.1f", means[row] * 1e6);
+        DrawText(text, x + labelWidth + columnWidth, y, fontSize, WHITE);
+        snprintf(text, sizeof(text), "%.1f", maxima[row] * 1e6);
+        DrawText(text, x + labelWidth + 2 * columnWidth, y, fontSize, WHITE);
+        y += lineHeight;
+    }
+
+    if (engine == NULL)
+    {
+        return;
+    }
+
+    // The analysis runs one worker thread, its utilisation is the share of time it spent searching
+    char line[96];
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Analysis  depth %d/%d  %llu nodes  %.0f knps", engine->result.depth,
+             engine->result.seldepth, (unsigned long long)engine->result.nodes, engine->nps / 1000.0);
+    DrawText(line, x, y, fontSize, WHITE);
+    y += lineHeight;
+    snprintf(line, sizeof(line), "Hash %.1f%% full  1 thread %.0f%% busy  %s", engine->hashfull / 10.0,
+             engine->busy * 100, engine->searching ? "searching" : "done");
+    DrawText(line, x, y, fontSize, WHITE);
+}
+
+// The first PV_SAN_MOVES moves of a line in SAN, played on a copy of the position
+void format_pv(const game *position, const move *pv, uint length, char *text, size_t size)
+{
+    game line = *position;
+    size_t used = 0;
+    text[0] = '\0';
+
+    for (uint i = 0; i < length && i < (uint)PV_SAN_MOVES; i++)
+    {
+        char san[16];
+        move_to_SAN(&line, pv[i], san);
+        int written = snprintf(text + used, size - used, "%s%s", i ? " " : "", san);
+        if (written < 0 || (size_t)written >= size - used)
+        {
+            break;
+        }
+        used += written;
+        make_move(&line, pv[i]);
+    }
+}
+
+// Vertical bar in the rank label column, white's share grows from the bottom. Mates fill it completely
+void draw_eval_bar(int whiteScore)
+{
+    int x = BOARD_LABEL_WIDTH - EVAL_BAR_WIDTH - 4;
+    int height = CELL_SIZE * 8;
+    float whiteShare = (float)review_expected_score(whiteScore);
+    int whiteHeight = (int)(height * whiteShare);
+
+    DrawRectangle(x, MENU_BAR_HEIGHT, EVAL_BAR_WIDTH, height - whiteHeight, BLACK);
+    DrawRectangle(x, MENU_BAR_HEIGHT + height - whiteHeight, EVAL_BAR_WIDTH, whiteHeight, RAYWHITE);
+}
+
+void draw_move_arrow(move m, Color color)
 {
-    snprintf(path, size, "assets/highres/%s.png", piece_strings[piece]);
+    Vector2 from = {BOARD_LABEL_WIDTH + m.x_from * CELL_SIZE + CELL_SIZE / 2,
+                    MENU_BAR_HEIGHT + m.y_from * CELL_SIZE + CELL_SIZE / 2};
+    Vector2 to = {BOARD_LABEL_WIDTH + m.x_to * CELL_SIZE + CELL_SIZE / 2,
+                  MENU_BAR_HEIGHT + m.y_to * CELL_SIZE + CELL_SIZE / 2};
+
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    float length = sqrtf(dx * dx + dy * dy);
+    dx /= length;
+    dy /= length;
+
+    float headLength = CELL_SIZE / 3.0f;
+    float headWidth = CELL_SIZE / 5.0f;
+    Vector2 base = {to.x - dx * headLength, to.y - dy * headLength};
+    Vector2 left = {base.x + dy * headWidth, base.y - dx * headWidth};
+    Vector2 right = {base.x - dy * headWidth, base.y + dx * headWidth};
+
+    DrawLineEx(from, base, CELL_SIZE / 8.0f, color);
+
+    // raylib culls triangles that aren't counter-clockwise on screen
+    if ((left.x - to.x) * (right.y - to.y) - (left.y - to.y) * (right.x - to.x) < 0)
+    {
+        DrawTriangle(to, left, right, color);
+    }
+    else
+    {
+        DrawTriangle(to, right, left, color);
+    }
 }
 
-// Don't forget to unload texture after game loop
-Texture2D get_piece_texture(piece_type piece)
+// "12... Nxe5??  +0.40 -> -2.10, best Qd2" for a reviewed move, scores from white's view
+void describe_review(game_review *review, uint ply, char *text, size_t size)
 {
-    char path[128];
-    get_piece_path(piece, path, sizeof(path));
-    Image image = LoadImage(path);
-    Texture2D texture = LoadTextureFromImage(image);
-    UnloadImage(image);
-
-    return texture; // We don't have to use buffers and can just return it since the texture is stored on the GPU and not the stack
-}
\ No newline at end of file
+    const ply_review *reviewed = &review->plies[ply];
+    game *position = &review->scratch;
+    *position = review->played;
+    while (position->move_history.count > ply)
+    {
+        undo_last_move(position);
+    }
+
+    char played[16], best[16], before[16], after[16];
+    int sign = (position->current_turn == CChessWhite) ? 1 : -1;
+    move_to_SAN(position, reviewed->played, played);
+    move_to_SAN(position, reviewed->best, best);
+    review_format_score(sign * reviewed->score_before, before, sizeof(before));
+    review_format_score(sign * reviewed->score_after, after, sizeof(after));
+
+    snprintf(text, size, "%u%s %s%s  %s -> %s, best %s", position->fullmove_number,
+             position->current_turn == CChessWhite ? "." : "...", played, review_grade_suffix(reviewed->grade), before,
+             after, best);
+}
@@ -0,0 +1,87 @@
+#include "mapfile.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+bool map_file(const char *path, mapped_file *out)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+    {
+        return false;
+    }
+
+    out->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (out->data == NULL)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    out->size = (size_t)size.QuadPart;
+    out->handle = mapping;
+    return true;
+}
+
+void unmap_file(mapped_file *file)
+{
+    UnmapViewOfFile(file->data);
+    CloseHandle(file->handle);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool map_file(const char *path, mapped_file *out)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    out->data = data;
+    out->size = st.st_size;
+    out->handle = data;
+    return true;
+}
+
+void unmap_file(mapped_file *file)
+{
+    munmap(file->handle, file->size);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only memory mapping of a whole file (mmap, MapViewOfFile on Windows)
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    void *handle; // Platform handle needed to unmap
+} mapped_file;
+
+// Fails for missing and empty files
+bool map_file(const char *path, mapped_file *out);
+
+void unmap_file(mapped_file *file);
+
+#endif
@@ -0,0 +1,1006 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "chess.h"
+#include "process.h"
+#include "util.h"
+
+// Plays two UCI engines against each other, several games at a time:
+//   cchess-match [options] <engine 1 command> <engine 2 command>
+// Games are played in pairs: same opening, colours reversed. Options:
+//   -g games            number of games, rounded up to whole pairs (default 100)
+//   -c concurrency      games played at the same time (default one per core)
+//   -o openings.epd     start positions, used in order and repeated as needed
+//   -tc base+inc        clock per game and increment per move in seconds, e.g. 10+0.1
+//   -nodes n / -depth n / -movetime ms   limits sent with every go
+//   -hash mb            Hash option for both engines
+//   -pgn out.pgn        every finished game is appended here
+//   -name1 / -name2     names used in the PGN and the summary, default is the command
+//   -draw move,count,cp      adjudicate a draw from move number on, once both engines report |score| <= cp
+//                            for count moves each
+//   -resign count,cp    adjudicate a loss once the losing engine reports <= -cp and its opponent >= cp for count moves each
+//   -maxplies n         draw after this many plies (default 400)
+//   -sprt elo0,elo1[,alpha,beta]   sequential probability ratio test of H0: elo = elo0 against H1: elo = elo1, stops
+//                       as soon as one is accepted. Without -g the number of games is unlimited
+
+#define DEFAULT_GAMES 100
+#define DEFAULT_MAX_PLIES 400
+#define MAX_LINE_LENGTH 4096
+#define MAX_FEN_LENGTH 128
+#define HANDSHAKE_TIMEOUT 10.0 // Seconds an engine gets to answer uci and isready
+#define STALL_TIMEOUT 60.0     // Seconds an engine gets for a move when there is no clock
+#define TIME_MARGIN 0.05       // Seconds an engine may overstep its clock, covers the pipe round trip
+#define MATE_SCORE 30000       // "score mate n" becomes +-(MATE_SCORE - n)
+#define SPRT_MAX_PAIRS 1000000 // Upper bound on the games of an SPRT run without -g
+#define DEFAULT_SPRT_ERROR 0.05 // Alpha and beta, the chances of accepting the wrong hypothesis
+
+typedef struct
+{
+    const char *commands[2];
+    const char *names[2];
+    int pairs;
+    int concurrency;
+    char **openings; // FENs, NULL for the normal start position
+    int opening_count;
+    double base_time; // Seconds, 0 when not playing on a clock
+    double increment;
+    uint64_t nodes;
+    int depth;
+    int move_time; // Milliseconds
+    int hash;
+    int draw_move_number; // 0 disables draw adjudication
+    int draw_move_count;
+    int draw_score;
+    int resign_move_count; // 0 disables resign adjudication
+    int resign_score;
+    int max_plies;
+    FILE *pgn;
+    bool sprt;
+    double elo0; // Logistic elo of the first engine over the second under H0 and H1
+    double elo1;
+    double alpha;
+    double beta;
+} match_options;
+
+typedef struct
+{
+    int index;
+    int white;               // Engine playing white, the other one plays black
+    const char *result;      // "1-0", "0-1" or "1/2-1/2"
+    const char *termination; // PGN Termination tag
+    char reason[128];        // Why the game ended, written as the final comment
+    int plies;
+} game_record;
+
+typedef struct
+{
+    const match_options *options;
+    pthread_mutex_t lock; // Guards everything below and the PGN file
+    int next_pair;
+    int games_done;
+    int wins; // From the view of the first engine
+    int losses;
+    int draws;
+    int pentanomial[5]; // Finished pairs by the half points the first engine scored in them, 0 to 4
+    bool failed;        // An engine couldn't be started, no new games are handed out
+    bool decided;       // The SPRT accepted a hypothesis, pairs already started are still finished
+} match_state;
+
+// One per worker thread, the buffers are too big for a thread stack
+typedef struct
+{
+    match_state *state;
+    process *engines[2];
+    game *game;
+    char start_fen[MAX_FEN_LENGTH]; // Empty for the normal start position
+    char position_command[MAX_FEN_LENGTH + MAX_MOVES * 6];
+    char movetext[MAX_MOVES * 16];
+    char line[MAX_LINE_LENGTH];
+} worker;
+
+static bool parse_options(int argc, char **argv, match_options *options);
+static bool load_openings(const char *path, match_options *options);
+static void *run_worker(void *arg);
+static process *start_engine(const char *command, int hash, char *line);
+static bool wait_for(process *engine, const char *reply, double timeout, char *line);
+static bool play_game(worker *w, int index, game_record *record);
+static bool set_up_game(worker *w, int index, game_record *record);
+static void build_go_command(const match_options *options, const double clocks[2], char *str_buffer);
+static bool read_best_move(worker *w, process *engine, double timeout, char *best, int *score, bool *has_score);
+static void end_game(game_record *record, piece_color winner, bool draw, const char *termination, const char *reason);
+static void append_move(worker *w, move m);
+static int record_game(worker *w, const game_record *record);
+static void record_pair(match_state *state, int points);
+static double sprt_llr(const int pentanomial[5], double elo0, double elo1);
+static void sprt_fit(const double frequencies[5], double expected, double scales[5]);
+static void write_pgn(worker *w, const game_record *record);
+static void print_summary(const match_state *state);
+static void print_sprt(const match_state *state);
+
+static const char *color_names[] = {"White", "Black"};
+
+int main(int argc, char **argv)
+{
+    match_options options = {.pairs = (DEFAULT_GAMES + 1) / 2, .concurrency = cpu_count(), .max_plies = DEFAULT_MAX_PLIES};
+    if (!parse_options(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s [-g games] [-c concurrency] [-o openings.epd] [-tc base+inc] [-nodes n] [-depth n]\n",
+                argv[0]);
+        fprintf(stderr, "       [-movetime ms] [-hash mb] [-pgn out.pgn] [-name1 name] [-name2 name] [-draw move,count,cp]\n");
+        fprintf(stderr, "       [-resign count,cp] [-maxplies n] [-sprt elo0,elo1[,alpha,beta]]\n");
+        fprintf(stderr, "       <engine 1 command> <engine 2 command>\n");
+        return 1;
+    }
+
+    if (options.concurrency > options.pairs)
+    {
+        options.concurrency = options.pairs;
+    }
+
+    match_state state = {.options = &options};
+    pthread_mutex_init(&state.lock, NULL);
+
+    pthread_t *threads = malloc(options.concurrency * sizeof(pthread_t));
+    worker *workers = calloc(options.concurrency, sizeof(worker));
+    if (threads == NULL || workers == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    fprintf(stderr, "Playing %s%d games between %s and %s, %d at a time\n", options.sprt ? "up to " : "",
+            options.pairs * 2, options.names[0], options.names[1], options.concurrency);
+    if (options.sprt)
+    {
+        fprintf(stderr, "SPRT elo0 %.2f elo1 %.2f alpha %.3f beta %.3f\n", options.elo0, options.elo1, options.alpha,
+                options.beta);
+    }
+
+    int started = 0;
+    for (; started < options.concurrency; started++)
+    {
+        workers[started].state = &state;
+        if (pthread_create(&threads[started], NULL, run_worker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    print_summary(&state);
+    if (options.sprt)
+    {
+        print_sprt(&state);
+    }
+
+    if (options.pgn != NULL)
+    {
+        fclose(options.pgn);
+    }
+    pthread_mutex_destroy(&state.lock);
+    free(workers);
+    free(threads);
+    return (state.failed || started == 0) ? 1 : 0;
+}
+
+static bool parse_options(int argc, char **argv, match_options *options)
+{
+    bool games_given = false;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg += 2)
+    {
+        const char *option = argv[arg];
+        const char *value = argv[arg + 1];
+
+        if (strcmp(option, "-g") == 0)
+        {
+            options->pairs = (atoi(value) + 1) / 2;
+            games_given = true;
+        }
+        else if (strcmp(option, "-c") == 0)
+        {
+            options->concurrency = atoi(value);
+        }
+        else if (strcmp(option, "-o") == 0)
+        {
+            if (!load_openings(value, options))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(option, "-tc") == 0)
+        {
+            options->increment = 0;
+            if (sscanf(value, "%lf+%lf", &options->base_time, &options->increment) < 1 || options->base_time <= 0)
+            {
+                fprintf(stderr, "Invalid time control '%s'\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(option, "-nodes") == 0)
+        {
+            options->nodes = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(option, "-depth") == 0)
+        {
+            options->depth = atoi(value);
+        }
+        else if (strcmp(option, "-movetime") == 0)
+        {
+            options->move_time = atoi(value);
+        }
+        else if (strcmp(option, "-hash") == 0)
+        {
+            options->hash = atoi(value);
+        }
+        else if (strcmp(option, "-pgn") == 0)
+        {
+            options->pgn = fopen(value, "a");
+            if (options->pgn == NULL)
+            {
+                fprintf(stderr, "Could not open %s\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(option, "-name1") == 0 || strcmp(option, "-name2") == 0)
+        {
+            options->names[option[5] - '1'] = value;
+        }
+        else if (strcmp(option, "-draw") == 0)
+        {
+            if (sscanf(value, "%d,%d,%d", &options->draw_move_number, &options->draw_move_count, &options->draw_score) != 3)
+            {
+                fprintf(stderr, "Invalid draw adjudication '%s'\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(option, "-resign") == 0)
+        {
+            if (sscanf(value, "%d,%d", &options->resign_move_count, &options->resign_score) != 2)
+            {
+                fprintf(stderr, "Invalid resign adjudication '%s'\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(option, "-maxplies") == 0)
+        {
+            options->max_plies = atoi(value);
+        }
+        else if (strcmp(option, "-sprt") == 0)
+        {
+            options->alpha = options->beta = DEFAULT_SPRT_ERROR;
+            int count = sscanf(value, "%lf,%lf,%lf,%lf", &options->elo0, &options->elo1, &options->alpha, &options->beta);
+            if ((count != 2 && count != 4) || options->elo0 >= options->elo1 || options->alpha <= 0 ||
+                options->alpha >= 0.5 || options->beta <= 0 || options->beta >= 0.5)
+            {
+                fprintf(stderr, "Invalid SPRT bounds '%s'\n", value);
+                return false;
+            }
+            options->sprt = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return false;
+        }
+    }
+
+    if (argc - arg != 2)
+    {
+        return false;
+    }
+
+    if (options->base_time == 0 && options->nodes == 0 && options->depth == 0 && options->move_time == 0)
+    {
+        fprintf(stderr, "Need a time control, node, depth or move time limit\n");
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        options->commands[i] = argv[arg + i];
+        if (options->names[i] == NULL)
+        {
+            options->names[i] = options->commands[i];
+        }
+    }
+
+    // The move history can't hold more
+    if (options->max_plies <= 0 || options->max_plies > MAX_MOVES - 1)
+    {
+        options->max_plies = MAX_MOVES - 1;
+    }
+    if (options->sprt && !games_given)
+    {
+        options->pairs = SPRT_MAX_PAIRS;
+    }
+    if (options->pairs < 1)
+    {
+        options->pairs = 1;
+    }
+    if (options->concurrency < 1)
+    {
+        options->concurrency = 1;
+    }
+    return true;
+}
+
+static bool load_openings(const char *path, match_options *options)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    game *scratch = malloc(sizeof(game));
+    char line[MAX_LINE_LENGTH];
+    char fen[MAX_FEN_LENGTH];
+    int capacity = 0;
+    int line_number = 0;
+
+    while (scratch != NULL && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        if (!FEN_from_EPD(line, fen, sizeof(fen)))
+        {
+            continue;
+        }
+
+        if (!import_FEN(scratch, fen))
+        {
+            fprintf(stderr, "%s:%d: skipping invalid position\n", path, line_number);
+            continue;
+        }
+
+        if (options->opening_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            char **grown = realloc(options->openings, capacity * sizeof(char *));
+            if (grown == NULL)
+            {
+                break;
+            }
+            options->openings = grown;
+        }
+
+        options->openings[options->opening_count] = strdup(fen);
+        if (options->openings[options->opening_count] != NULL)
+        {
+            options->opening_count++;
+        }
+    }
+
+    free(scratch);
+    fclose(file);
+
+    if (options->opening_count == 0)
+    {
+        fprintf(stderr, "No positions in %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void *run_worker(void *arg)
+{
+    worker *w = arg;
+    match_state *state = w->state;
+    const match_options *options = state->options;
+
+    w->game = malloc(sizeof(game));
+    for (int i = 0; i < 2 && w->game != NULL; i++)
+    {
+        w->engines[i] = start_engine(options->commands[i], options->hash, w->line);
+    }
+
+    if (w->game == NULL || w->engines[0] == NULL || w->engines[1] == NULL)
+    {
+        pthread_mutex_lock(&state->lock);
+        if (!state->failed)
+        {
+            fprintf(stderr, "Could not start %s\n", (w->engines[0] == NULL) ? options->names[0] : options->names[1]);
+        }
+        state->failed = true;
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    while (true)
+    {
+        pthread_mutex_lock(&state->lock);
+        int pair = (state->failed || state->decided) ? options->pairs : state->next_pair++;
+        pthread_mutex_unlock(&state->lock);
+
+        if (pair >= options->pairs)
+        {
+            break;
+        }
+
+        int points = 0;
+        int played = 0;
+        for (int i = 0; i < 2; i++, played++)
+        {
+            game_record record;
+            bool engines_alive = play_game(w, pair * 2 + i, &record);
+            points += record_game(w, &record);
+
+            // A crashed or hung engine is replaced so the remaining games can still be played
+            for (int e = 0; e < 2 && !engines_alive; e++)
+            {
+                process_stop(w->engines[e]);
+                w->engines[e] = start_engine(options->commands[e], options->hash, w->line);
+                if (w->engines[e] == NULL)
+                {
+                    pthread_mutex_lock(&state->lock);
+                    fprintf(stderr, "Could not restart %s\n", options->names[e]);
+                    state->failed = true;
+                    pthread_mutex_unlock(&state->lock);
+                    i = 2;
+                }
+            }
+        }
+
+        // Half a pair says nothing about the opening, it is left out of the pair statistics
+        if (played == 2)
+        {
+            record_pair(state, points);
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (w->engines[i] != NULL)
+        {
+            process_write_line(w->engines[i], "quit");
+            process_stop(w->engines[i]);
+        }
+    }
+    free(w->game);
+    return NULL;
+}
+
+static process *start_engine(const char *command, int hash, char *line)
+{
+    process *engine = process_start(command);
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+
+    bool ok = process_write_line(engine, "uci") && wait_for(engine, "uciok", HANDSHAKE_TIMEOUT, line);
+    if (ok && hash > 0)
+    {
+        sprintf(line, "setoption name Hash value %d", hash);
+        ok = process_write_line(engine, line);
+    }
+    ok = ok && process_write_line(engine, "isready") && wait_for(engine, "readyok", HANDSHAKE_TIMEOUT, line);
+
+    if (!ok)
+    {
+        process_stop(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+static bool wait_for(process *engine, const char *reply, double timeout, char *line)
+{
+    double deadline = now_seconds() + timeout;
+    while (process_read_line(engine, line, MAX_LINE_LENGTH, deadline - now_seconds()))
+    {
+        if (strcmp(line, reply) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns false if an engine crashed or stopped answering and has to be restarted
+static bool play_game(worker *w, int index, game_record *record)
+{
+    const match_options *options = w->state->options;
+    game *g = w->game;
+
+    if (!set_up_game(w, index, record))
+    {
+        return false;
+    }
+
+    double clocks[2] = {options->base_time, options->base_time};
+    int draw_streak = 0;
+    int losing_streak[2] = {0, 0};
+    int winning_streak[2] = {0, 0};
+    size_t command_length = strlen(w->position_command);
+    char go_command[160];
+    char best[16];
+
+    while (true)
+    {
+        game_status status = check_game_over(g);
+        if (status == WhiteWon || status == BlackWon)
+        {
+            piece_color winner = (status == WhiteWon) ? CChessWhite : CChessBlack;
+            sprintf(record->reason, "%s mates", color_names[winner]);
+            end_game(record, winner, false, "normal", NULL);
+            return true;
+        }
+        if (status != InProgress)
+        {
+            const char *reasons[] = {"", "", "", "Stalemate", "Insufficient material", "Fifty move rule",
+                                     "Threefold repetition"};
+            end_game(record, CChessWhite, true, "normal", reasons[status]);
+            return true;
+        }
+        if (record->plies >= options->max_plies)
+        {
+            end_game(record, CChessWhite, true, "adjudication", "Maximum game length reached");
+            return true;
+        }
+
+        piece_color side = g->current_turn;
+        piece_color opponent = !side;
+        process *engine = w->engines[(side == CChessWhite) ? record->white : !record->white];
+
+        build_go_command(options, clocks, go_command);
+        double timeout = STALL_TIMEOUT;
+        if (options->base_time > 0)
+        {
+            timeout = clocks[side] + TIME_MARGIN;
+        }
+        else if (options->move_time > 0)
+        {
+            timeout = options->move_time / 1000.0 + STALL_TIMEOUT;
+        }
+
+        double start = now_seconds();
+        int score = 0;
+        bool has_score = false;
+        bool answered = process_write_line(engine, w->position_command) && process_write_line(engine, go_command) &&
+                        read_best_move(w, engine, timeout, best, &score, &has_score);
+        double elapsed = now_seconds() - start;
+
+        if (!answered)
+        {
+            if (options->base_time > 0 && elapsed >= timeout)
+            {
+                sprintf(record->reason, "%s loses on time", color_names[side]);
+                end_game(record, opponent, false, "time forfeit", NULL);
+            }
+            else
+            {
+                sprintf(record->reason, "%s disconnects or stalls", color_names[side]);
+                end_game(record, opponent, false, "abandoned", NULL);
+            }
+            return false;
+        }
+
+        if (options->base_time > 0)
+        {
+            clocks[side] -= elapsed;
+            if (clocks[side] < -TIME_MARGIN)
+            {
+                sprintf(record->reason, "%s loses on time", color_names[side]);
+                end_game(record, opponent, false, "time forfeit", NULL);
+                return true;
+            }
+            clocks[side] += options->increment;
+        }
+
+        move m;
+        if (!move_from_UCI(g, best, &m))
+        {
+            snprintf(record->reason, sizeof(record->reason), "%s makes an illegal move: %s", color_names[side], best);
+            end_game(record, opponent, false, "rules infraction", NULL);
+            return true;
+        }
+
+        append_move(w, m);
+        make_move(g, m);
+        record->plies++;
+
+        if (record->plies == 1)
+        {
+            strcpy(w->position_command + command_length, " moves");
+            command_length += strlen(" moves");
+        }
+        w->position_command[command_length++] = ' ';
+        move_to_UCI(m, w->position_command + command_length);
+        command_length += strlen(w->position_command + command_length);
+
+        // Scores are from the view of the side that just moved. Engines that send no score are never adjudicated
+        draw_streak = (has_score && abs(score) <= options->draw_score) ? draw_streak + 1 : 0;
+        losing_streak[side] = (has_score && score <= -options->resign_score) ? losing_streak[side] + 1 : 0;
+        winning_streak[side] = (has_score && score >= options->resign_score) ? winning_streak[side] + 1 : 0;
+
+        if (options->draw_move_number > 0 && (int)g->fullmove_number > options->draw_move_number &&
+            draw_streak >= 2 * options->draw_move_count)
+        {
+            end_game(record, CChessWhite, true, "adjudication", "Draw by adjudication");
+            return true;
+        }
+
+        if (options->resign_move_count > 0 && losing_streak[side] >= options->resign_move_count &&
+            winning_streak[opponent] >= options->resign_move_count)
+        {
+            sprintf(record->reason, "%s resigns", color_names[side]);
+            end_game(record, opponent, false, "adjudication", NULL);
+            return true;
+        }
+    }
+}
+
+static bool set_up_game(worker *w, int index, game_record *record)
+{
+    const match_options *options = w->state->options;
+
+    memset(record, 0, sizeof(*record));
+    record->index = index;
+    record->white = index % 2; // The second game of a pair swaps colours
+
+    w->start_fen[0] = '\0';
+    w->movetext[0] = '\0';
+    reset_game(w->game);
+
+    if (options->openings != NULL)
+    {
+        const char *fen = options->openings[(index / 2) % options->opening_count];
+        import_FEN(w->game, fen);
+        export_FEN(w->game, w->start_fen); // Adds clocks missing from the EPD
+        sprintf(w->position_command, "position fen %s", w->start_fen);
+    }
+    else
+    {
+        strcpy(w->position_command, "position startpos");
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!process_write_line(w->engines[i], "ucinewgame") || !process_write_line(w->engines[i], "isready") ||
+            !wait_for(w->engines[i], "readyok", HANDSHAKE_TIMEOUT, w->line))
+        {
+            piece_color color = (i == record->white) ? CChessWhite : CChessBlack;
+            sprintf(record->reason, "%s disconnects or stalls", color_names[color]);
+            end_game(record, !color, false, "abandoned", NULL);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void build_go_command(const match_options *options, const double clocks[2], char *str_buffer)
+{
+    int length = sprintf(str_buffer, "go");
+    if (options->base_time > 0)
+    {
+        int increment = (int)(options->increment * 1000);
+        length += sprintf(str_buffer + length, " wtime %d btime %d winc %d binc %d", (int)(clocks[CChessWhite] * 1000),
+                          (int)(clocks[CChessBlack] * 1000), increment, increment);
+    }
+    if (options->nodes > 0)
+    {
+        length += sprintf(str_buffer + length, " nodes %llu", (unsigned long long)options->nodes);
+    }
+    if (options->depth > 0)
+    {
+        length += sprintf(str_buffer + length, " depth %d", options->depth);
+    }
+    if (options->move_time > 0)
+    {
+        sprintf(str_buffer + length, " movetime %d", options->move_time);
+    }
+}
+
+// Reads up to the bestmove line, keeping the last score of the info lines before it
+static bool read_best_move(worker *w, process *engine, double timeout, char *best, int *score, bool *has_score)
+{
+    double deadline = now_seconds() + timeout;
+
+    while (process_read_line(engine, w->line, MAX_LINE_LENGTH, deadline - now_seconds()))
+    {
+        if (strncmp(w->line, "bestmove ", 9) == 0)
+        {
+            sscanf(w->line + 9, "%15s", best);
+            return true;
+        }
+
+        char *found = (strncmp(w->line, "info ", 5) == 0) ? strstr(w->line, " score ") : NULL;
+        int value;
+        if (found != NULL && sscanf(found, " score cp %d", &value) == 1)
+        {
+            *score = value;
+            *has_score = true;
+        }
+        else if (found != NULL && sscanf(found, " score mate %d", &value) == 1)
+        {
+            *score = (value > 0) ? MATE_SCORE - value : -MATE_SCORE - value;
+            *has_score = true;
+        }
+    }
+    return false;
+}
+
+static void end_game(game_record *record, piece_color winner, bool draw, const char *termination, const char *reason)
+{
+    record->result = draw ? "1/2-1/2" : (winner == CChessWhite) ? "1-0" : "0-1";
+    record->termination = termination;
+    if (reason != NULL)
+    {
+        snprintf(record->reason, sizeof(record->reason), "%s", reason);
+    }
+}
+
+static void append_move(worker *w, move m)
+{
+    game *g = w->game;
+    size_t length = strlen(w->movetext);
+
+    if (g->current_turn == CChessWhite)
+    {
+        length += sprintf(w->movetext + length, "%s%u. ", length ? " " : "", g->fullmove_number);
+    }
+    else if (length == 0)
+    {
+        length += sprintf(w->movetext, "%u... ", g->fullmove_number);
+    }
+    else
+    {
+        w->movetext[length++] = ' ';
+    }
+
+    move_to_SAN(g, m, w->movetext + length);
+}
+
+// Returns the half points the first engine scored
+static int record_game(worker *w, const game_record *record)
+{
+    match_state *state = w->state;
+    const match_options *options = state->options;
+
+    // Points of the first engine, counted in half points
+    int points = (record->result[0] == '1' && record->result[1] == '/') ? 1 : (record->result[0] == '1') ? 2 : 0;
+    if (record->white == 1)
+    {
+        points = 2 - points;
+    }
+
+    pthread_mutex_lock(&state->lock);
+
+    state->games_done++;
+    state->wins += (points == 2);
+    state->draws += (points == 1);
+    state->losses += (points == 0);
+
+    fprintf(stderr, "Game %d: %s vs %s %s {%s}\n", record->index + 1, options->names[record->white],
+            options->names[!record->white], record->result, record->reason);
+    fprintf(stderr, "Score of %s vs %s: %d - %d - %d  [%.3f] %d/%d\n", options->names[0], options->names[1], state->wins,
+            state->losses, state->draws, (state->wins + state->draws * 0.5) / state->games_done, state->games_done,
+            options->pairs * 2);
+
+    if (options->pgn != NULL)
+    {
+        write_pgn(w, record);
+    }
+
+    pthread_mutex_unlock(&state->lock);
+    return points;
+}
+
+static void record_pair(match_state *state, int points)
+{
+    const match_options *options = state->options;
+
+    pthread_mutex_lock(&state->lock);
+    state->pentanomial[points]++;
+
+    if (options->sprt && !state->decided)
+    {
+        double llr = sprt_llr(state->pentanomial, options->elo0, options->elo1);
+        double lower = log(options->beta / (1 - options->alpha));
+        double upper = log((1 - options->beta) / options->alpha);
+
+        const int *p = state->pentanomial;
+        fprintf(stderr, "Pentanomial [%d, %d, %d, %d, %d]  LLR %.2f (%.2f, %.2f)\n", p[0], p[1], p[2], p[3], p[4], llr,
+                lower, upper);
+
+        if (llr <= lower || llr >= upper)
+        {
+            state->decided = true;
+            fprintf(stderr, "%s accepted, finishing the games in progress\n", (llr >= upper) ? "H1" : "H0");
+        }
+    }
+
+    pthread_mutex_unlock(&state->lock);
+}
+
+// Generalized log-likelihood ratio of H1 over H0: the observed pair score frequencies are compared with the most likely
+// distributions that have the expected score of each hypothesis. Pairs share an opening, so their scores vary less than
+// those of single games and the test ends sooner
+static double sprt_llr(const int pentanomial[5], double elo0, double elo1)
+{
+    // A small prior in every bucket keeps the distributions positive before all outcomes have been seen
+    double frequencies[5], total = 0;
+    int pairs = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        frequencies[i] = pentanomial[i] + 1e-3;
+        total += frequencies[i];
+        pairs += pentanomial[i];
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        frequencies[i] /= total;
+    }
+
+    double scales0[5], scales1[5];
+    sprt_fit(frequencies, 1 / (1 + pow(10, -elo0 / 400)), scales0);
+    sprt_fit(frequencies, 1 / (1 + pow(10, -elo1 / 400)), scales1);
+
+    double llr = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        llr += frequencies[i] * log(scales0[i] / scales1[i]);
+    }
+    return pairs * llr;
+}
+
+// The distribution with expected score closest to the frequencies is frequencies[i] / scales[i] with
+// scales[i] = 1 + theta * (score_i - expected), where theta makes the expected score come out right
+static void sprt_fit(const double frequencies[5], double expected, double scales[5])
+{
+    // Scales have to stay positive, which bounds theta on both sides. The expected score is strictly between 0 and 1
+    double low = -1 / (1 - expected) + 1e-9;
+    double high = 1 / expected - 1e-9;
+
+    // The expected score of the fitted distribution falls as theta grows
+    for (int iteration = 0; iteration < 100; iteration++)
+    {
+        double theta = (low + high) / 2;
+        double sum = 0;
+        for (int i = 0; i < 5; i++)
+        {
+            double difference = i / 4.0 - expected;
+            sum += frequencies[i] * difference / (1 + theta * difference);
+        }
+
+        if (sum > 0)
+        {
+            low = theta;
+        }
+        else
+        {
+            high = theta;
+        }
+    }
+
+    double theta = (low + high) / 2;
+    for (int i = 0; i < 5; i++)
+    {
+        scales[i] = 1 + theta * (i / 4.0 - expected);
+    }
+}
+
+static void write_pgn(worker *w, const game_record *record)
+{
+    const match_options *options = w->state->options;
+    FILE *out = options->pgn;
+
+    time_t now = time(NULL);
+    char date[16];
+    strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+
+    fprintf(out, "[Event \"cchess match\"]\n[Site \"?\"]\n[Date \"%s\"]\n[Round \"%d\"]\n", date, record->index + 1);
+    fprintf(out, "[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n", options->names[record->white],
+            options->names[!record->white], record->result);
+    if (w->start_fen[0] != '\0')
+    {
+        fprintf(out, "[FEN \"%s\"]\n[SetUp \"1\"]\n", w->start_fen);
+    }
+    if (options->base_time > 0)
+    {
+        fprintf(out, "[TimeControl \"%g+%g\"]\n", options->base_time, options->increment);
+    }
+    fprintf(out, "[PlyCount \"%d\"]\n[Termination \"%s\"]\n\n", record->plies, record->termination);
+
+    // Movetext wrapped at 80 columns as the PGN export format asks for
+    char tail[sizeof(record->reason) + 32];
+    snprintf(tail, sizeof(tail), "{%s} %s", record->reason, record->result);
+
+    int column = 0;
+    const char *p = w->movetext;
+    while (true)
+    {
+        while (*p == ' ')
+        {
+            p++;
+        }
+
+        bool at_tail = (*p == '\0');
+        const char *token = at_tail ? tail : p;
+        int length = at_tail ? (int)strlen(tail) : (int)strcspn(p, " ");
+
+        if (column > 0 && column + 1 + length > 80)
+        {
+            fputc('\n', out);
+            column = 0;
+        }
+        else if (column > 0)
+        {
+            fputc(' ', out);
+            column++;
+        }
+
+        fwrite(token, 1, length, out);
+        column += length;
+
+        if (at_tail)
+        {
+            break;
+        }
+        p += length;
+    }
+
+    fputs("\n\n", out);
+    fflush(out);
+}
+
+static void print_summary(const match_state *state)
+{
+    const match_options *options = state->options;
+    int games = state->games_done;
+
+    printf("%s vs %s: %d - %d - %d", options->names[0], options->names[1], state->wins, state->losses, state->draws);
+    if (games == 0)
+    {
+        printf("\n");
+        return;
+    }
+
+    double score = (state->wins + 0.5 * state->draws) / games;
+    printf("  [%.3f] %d games\n", score, games);
+
+    if (state->wins == 0 || state->losses == 0)
+    {
+        // All wins or all losses give an infinite difference
+        if (state->wins != state->losses)
+        {
+            printf("Elo difference: %s\n", (state->wins > 0) ? "+inf" : "-inf");
+            return;
+        }
+    }
+
+    // Normal approximation of the per game score around its mean
+    double variance = (state->wins * pow(1 - score, 2) + state->losses * pow(score, 2) +
+                       state->draws * pow(0.5 - score, 2)) / games;
+    double deviation = sqrt(variance / games);
+    double low = fmax(score - 1.96 * deviation, 1e-6);
+    double high = fmin(score + 1.96 * deviation, 1 - 1e-6);
+
+    double elo = -400 * log10(1 / score - 1) + 0.0; // No "-0.0" for an even score
+    double margin = (-400 * log10(1 / high - 1) - -400 * log10(1 / low - 1)) / 2;
+    printf("Elo difference: %.1f +/- %.1f\n", elo, margin);
+}
+
+static void print_sprt(const match_state *state)
+{
+    const match_options *options = state->options;
+    const int *p = state->pentanomial;
+
+    double llr = sprt_llr(p, options->elo0, options->elo1);
+    double lower = log(options->beta / (1 - options->alpha));
+    double upper = log((1 - options->beta) / options->alpha);
+    const char *verdict = (llr >= upper) ? "H1 accepted" : (llr <= lower) ? "H0 accepted" : "inconclusive";
+
+    printf("Pentanomial [%d, %d, %d, %d, %d]\n", p[0], p[1], p[2], p[3], p[4]);
+    printf("SPRT elo0 %.2f elo1 %.2f: LLR %.2f (%.2f, %.2f) %s\n", options->elo0, options->elo1, llr, lower, upper,
+           verdict);
+}
@@ -0,0 +1,318 @@
+// Times the core rule functions one by one and prints the results as JSON:
+//   cchess-microbench [-s samples] [-t milliseconds per sample] [name filter]
+// The rules engine is compiled into this file so the static helpers can be measured directly
+#include "chess.c"
+#include "util.h"
+
+#define DEFAULT_SAMPLES 50
+#define DEFAULT_SAMPLE_MS 2.0
+#define WARMUP_SECONDS 0.2 // Run before calibrating, so caches and branch predictors are warm and clocks have ramped up
+
+typedef struct
+{
+    const char *name;
+    const char *fen;
+} bench_position;
+
+// Opening, tactics heavy middlegames and endgames, so no function is measured on one kind of position only
+static const bench_position positions[] = {
+    {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"},
+    {"middlegame", "r1bq1rk1/pp2b1pp/n1pp1n2/3P1p2/2P1p3/2N1P2N/PP2BPPP/R1BQ1RK1 b - - 2 10"},
+    {"check", "r1bqr1k1/pp1p1ppp/2p5/8/3N1Q2/P2BB3/1PP2PPP/R3K2n b Q - 1 12"},
+    {"rook endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"},
+    {"pawn endgame", "8/8/1p2k1p1/3p3p/1p1P1P1P/1P2PK2/8/8 w - - 3 54"},
+};
+
+#define POSITION_COUNT (sizeof(positions) / sizeof(positions[0]))
+
+// Returns the number of operations done on the position
+typedef uint64_t (*bench_function)(game *game, uint position);
+
+typedef struct
+{
+    const char *name;
+    bench_function run;
+} benchmark;
+
+typedef struct
+{
+    uint64_t ops_per_sample;
+    double mean, min, p50, p90, p99, max; // Nanoseconds per operation
+} bench_stats;
+
+static game games[POSITION_COUNT];
+static move legal_moves[POSITION_COUNT][MAX_POSITION_MOVES];
+static uint legal_move_counts[POSITION_COUNT];
+static game scratch;
+static volatile uint64_t sink; // Results go here so the compiler can't drop the calls
+
+static uint64_t bench_get_valid_moves(game *game, uint position);
+static uint64_t bench_add_pseudo_legal_moves(game *game, uint position);
+static uint64_t bench_generate_legal_moves(game *game, uint position);
+static uint64_t bench_is_square_attacked(game *game, uint position);
+static uint64_t bench_is_in_check(game *game, uint position);
+static uint64_t bench_make_undo_move(game *game, uint position);
+static uint64_t bench_check_game_over(game *game, uint position);
+static uint64_t bench_import_FEN(game *game, uint position);
+static uint64_t bench_export_FEN(game *game, uint position);
+static uint64_t run_round(bench_function run);
+static bench_stats measure(bench_function run, int samples, double sample_seconds);
+static int compare_doubles(const void *a, const void *b);
+static double percentile(const double *sorted, int count, double fraction);
+
+static const benchmark benchmarks[] = {
+    {"get_valid_moves", bench_get_valid_moves},
+    {"add_pseudo_legal_moves", bench_add_pseudo_legal_moves},
+    {"generate_legal_moves", bench_generate_legal_moves},
+    {"is_square_attacked", bench_is_square_attacked},
+    {"is_in_check", bench_is_in_check},
+    {"make_move+undo_last_move", bench_make_undo_move},
+    {"check_game_over", bench_check_game_over},
+    {"import_FEN", bench_import_FEN},
+    {"export_FEN", bench_export_FEN},
+};
+
+int main(int argc, char **argv)
+{
+    int samples = DEFAULT_SAMPLES;
+    double sample_ms = DEFAULT_SAMPLE_MS;
+    int arg = 1;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (strcmp(argv[arg], "-s") == 0)
+        {
+            samples = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-t") == 0)
+        {
+            sample_ms = atof(argv[arg + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (arg < argc - 1 || samples < 1 || sample_ms <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-s samples] [-t milliseconds per sample] [name filter]\n", argv[0]);
+        return 1;
+    }
+    const char *filter = (arg < argc) ? argv[arg] : NULL;
+
+    for (uint i = 0; i < POSITION_COUNT; i++)
+    {
+        if (!import_FEN(&games[i], positions[i].fen))
+        {
+            fprintf(stderr, "Invalid position %s\n", positions[i].name);
+            return 1;
+        }
+        legal_move_counts[i] = generate_legal_moves(&games[i], legal_moves[i]);
+    }
+
+    printf("{\n  \"positions\": [");
+    for (uint i = 0; i < POSITION_COUNT; i++)
+    {
+        printf("%s\"%s\"", i ? ", " : "", positions[i].name);
+    }
+    printf("],\n  \"samples\": %d,\n  \"benchmarks\": [", samples);
+
+    bool first = true;
+    for (uint i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+        {
+            continue;
+        }
+
+        bench_stats stats = measure(benchmarks[i].run, samples, sample_ms / 1000);
+        printf("%s\n    {\"name\": \"%s\", \"ops_per_sample\": %llu, \"mean_ns\": %.2f, \"min_ns\": %.2f, "
+               "\"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"max_ns\": %.2f}",
+               first ? "" : ",", benchmarks[i].name, (unsigned long long)stats.ops_per_sample, stats.mean, stats.min,
+               stats.p50, stats.p90, stats.p99, stats.max);
+        fflush(stdout);
+        first = false;
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
+
+// One call per square holding a piece of the side to move, as the GUI does when a piece is picked up
+static uint64_t bench_get_valid_moves(game *game, uint position)
+{
+    (void)position;
+    uint64_t ops = 0;
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            if (game->board[y][x] != EMPTY && get_piece_color(game->board[y][x]) == game->current_turn)
+            {
+                sink += get_valid_moves(game, x, y).count;
+                ops++;
+            }
+        }
+    }
+    return ops;
+}
+
+static uint64_t bench_add_pseudo_legal_moves(game *game, uint position)
+{
+    (void)position;
+    move moves[MAX_PIECE_MOVES];
+    uint64_t ops = 0;
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            if (game->board[y][x] != EMPTY && get_piece_color(game->board[y][x]) == game->current_turn)
+            {
+                uint count = 0;
+                add_pseudo_legal_moves(game, x, y, moves, &count);
+                sink += count;
+                ops++;
+            }
+        }
+    }
+    return ops;
+}
+
+static uint64_t bench_generate_legal_moves(game *game, uint position)
+{
+    (void)position;
+    move moves[MAX_POSITION_MOVES];
+    sink += generate_legal_moves(game, moves);
+    return 1;
+}
+
+// Every square, attacked by the side not to move
+static uint64_t bench_is_square_attacked(game *game, uint position)
+{
+    (void)position;
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            sink += is_square_attacked(game, x, y, !game->current_turn);
+        }
+    }
+    return 64;
+}
+
+static uint64_t bench_is_in_check(game *game, uint position)
+{
+    (void)position;
+    sink += is_in_check(game, game->current_turn);
+    return 1;
+}
+
+// Every legal move of the position, made and taken back
+static uint64_t bench_make_undo_move(game *game, uint position)
+{
+    for (uint i = 0; i < legal_move_counts[position]; i++)
+    {
+        sink += make_move(game, legal_moves[position][i]);
+        undo_last_move(game);
+    }
+    return legal_move_counts[position];
+}
+
+static uint64_t bench_check_game_over(game *game, uint position)
+{
+    (void)position;
+    sink += check_game_over(game);
+    return 1;
+}
+
+static uint64_t bench_import_FEN(game *game, uint position)
+{
+    (void)game;
+    sink += import_FEN(&scratch, positions[position].fen);
+    return 1;
+}
+
+static uint64_t bench_export_FEN(game *game, uint position)
+{
+    (void)position;
+    char fen[128];
+    export_FEN(game, fen);
+    sink += fen[0];
+    return 1;
+}
+
+static uint64_t run_round(bench_function run)
+{
+    uint64_t ops = 0;
+    for (uint i = 0; i < POSITION_COUNT; i++)
+    {
+        ops += run(&games[i], i);
+    }
+    return ops;
+}
+
+// Every sample repeats rounds over all positions for about sample_seconds, the round count is fixed after warm-up
+static bench_stats measure(bench_function run, int samples, double sample_seconds)
+{
+    bench_stats stats = {0};
+
+    uint64_t rounds = 0;
+    double start = now_seconds();
+    while (now_seconds() - start < WARMUP_SECONDS)
+    {
+        run_round(run);
+        rounds++;
+    }
+
+    uint64_t rounds_per_sample = (uint64_t)(rounds * sample_seconds / WARMUP_SECONDS);
+    if (rounds_per_sample == 0)
+    {
+        rounds_per_sample = 1;
+    }
+
+    double *times = malloc(samples * sizeof(double));
+    if (times == NULL)
+    {
+        return stats;
+    }
+
+    for (int s = 0; s < samples; s++)
+    {
+        uint64_t ops = 0;
+        double sample_start = now_seconds();
+        for (uint64_t r = 0; r < rounds_per_sample; r++)
+        {
+            ops += run_round(run);
+        }
+        times[s] = (now_seconds() - sample_start) * 1e9 / ops;
+        stats.ops_per_sample = ops;
+        stats.mean += times[s] / samples;
+    }
+
+    qsort(times, samples, sizeof(double), compare_doubles);
+    stats.min = times[0];
+    stats.p50 = percentile(times, samples, 0.5);
+    stats.p90 = percentile(times, samples, 0.9);
+    stats.p99 = percentile(times, samples, 0.99);
+    stats.max = times[samples - 1];
+
+    free(times);
+    return stats;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear interpolation between the two closest ranks
+static double percentile(const double *sorted, int count, double fraction)
+{
+    double rank = fraction * (count - 1);
+    int lower = (int)rank;
+    int upper = (lower + 1 < count) ? lower + 1 : lower;
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - lower);
+}
@@ -0,0 +1,545 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "optree.h"
+
+#define OPTREE_HEADER_SIZE 16
+#define GAMES_PER_BATCH 256
+#define INITIAL_MAP_CAPACITY (1 << 16)
+
+// Open addressing hash map from position key to its statistics, key 0 marks an empty slot
+typedef struct
+{
+    optree_node *slots;
+    uint64_t capacity; // Power of two
+    uint64_t count;
+} node_map;
+
+// Where the games come from, shared by all workers
+typedef struct
+{
+    const optree_options *options;
+    const gamedb *db;
+    pgn_reader *pgn;
+
+    pthread_mutex_t lock;
+    uint64_t next_game;
+    bool pgn_done;
+} build_source;
+
+typedef struct
+{
+    build_source *source;
+    node_map map;
+    bool ok;
+} build_thread;
+
+// One key range of the merge, over every worker's sorted map
+typedef struct
+{
+    const build_thread *threads;
+    int thread_count;
+    const uint64_t *begin; // Per thread, the first node in range
+    const uint64_t *end;
+    uint min_games;
+    optree_node *out;
+    uint64_t count;
+} merge_shard;
+
+static bool build(build_source *source, const char *path);
+static void *build_worker(void *arg);
+static bool add_game(node_map *map, game *g, const char *fen, const gamedb_move *moves, uint ply_count, pgn_result result, uint max_ply);
+static bool map_add(node_map *map, uint64_t key, pgn_result result);
+static bool map_grow(node_map *map);
+static void map_sort(node_map *map);
+static uint64_t lower_bound(const optree_node *nodes, uint64_t count, uint64_t key);
+static void *merge_worker(void *arg);
+static void add_stats(optree_node *to, const optree_node *from);
+static int compare_nodes(const void *a, const void *b);
+static int compare_children(const void *a, const void *b);
+
+bool optree_build_from_db(const gamedb *db, const char *path, const optree_options *options)
+{
+    build_source source = {.options = options, .db = db};
+    return build(&source, path);
+}
+
+bool optree_build_from_pgn(pgn_reader *reader, const char *path, const optree_options *options)
+{
+    build_source source = {.options = options, .pgn = reader};
+    return build(&source, path);
+}
+
+optree *optree_open(const char *path)
+{
+    optree *tree = calloc(1, sizeof(optree));
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    if (!map_file(path, &tree->file))
+    {
+        free(tree);
+        return NULL;
+    }
+
+    uint32_t version;
+    const uint8_t *data = tree->file.data;
+    if (tree->file.size < OPTREE_HEADER_SIZE || memcmp(data, OPTREE_MAGIC, 4) != 0)
+    {
+        optree_close(tree);
+        return NULL;
+    }
+
+    memcpy(&version, data + 4, sizeof(version));
+    memcpy(&tree->node_count, data + 8, sizeof(tree->node_count));
+
+    if (version != OPTREE_VERSION || tree->node_count > (tree->file.size - OPTREE_HEADER_SIZE) / sizeof(optree_node))
+    {
+        optree_close(tree);
+        return NULL;
+    }
+
+    tree->nodes = (const optree_node *)(data + OPTREE_HEADER_SIZE);
+    return tree;
+}
+
+void optree_close(optree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+
+    unmap_file(&tree->file);
+    free(tree);
+}
+
+const optree_node *optree_find(const optree *tree, uint64_t key)
+{
+    uint64_t i = lower_bound(tree->nodes, tree->node_count, key);
+    return (i < tree->node_count && tree->nodes[i].key == key) ? &tree->nodes[i] : NULL;
+}
+
+uint optree_children(const optree *tree, game *game, optree_child *out, uint max_children)
+{
+    move_list moves = get_all_valid_moves(game);
+    uint count = 0;
+
+    for (uint i = 0; i < moves.count && count < max_children; i++)
+    {
+        make_move(game, moves.moves[i]);
+        const optree_node *node = optree_find(tree, game->hash);
+        undo_last_move(game);
+
+        if (node != NULL)
+        {
+            out[count++] = (optree_child){.move = moves.moves[i], .stats = *node};
+        }
+    }
+
+    qsort(out, count, sizeof(optree_child), compare_children);
+    return count;
+}
+
+static bool build(build_source *source, const char *path)
+{
+    int thread_count = source->options->threads > 0 ? source->options->threads : 1;
+    build_thread *threads = calloc(thread_count, sizeof(build_thread));
+    pthread_t *workers = malloc(sizeof(pthread_t) * thread_count);
+    uint64_t *bounds = malloc(sizeof(uint64_t) * (thread_count + 1) * thread_count);
+    merge_shard *shards = calloc(thread_count, sizeof(merge_shard));
+
+    if (threads == NULL || workers == NULL || bounds == NULL || shards == NULL)
+    {
+        free(threads);
+        free(workers);
+        free(bounds);
+        free(shards);
+        return false;
+    }
+
+    // Every worker counts into its own map, so there is no locking except for handing out games
+    pthread_mutex_init(&source->lock, NULL);
+    int started = 0;
+    for (; started < thread_count; started++)
+    {
+        threads[started].source = source;
+        if (pthread_create(&workers[started], NULL, build_worker, &threads[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    // The key ranges of the merge are split by thread count, so every thread has to be there
+    bool ok = started == thread_count;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+        ok = ok && threads[i].ok;
+    }
+    pthread_mutex_destroy(&source->lock);
+
+    // The maps are merged in parallel by splitting the key space into one range per thread. Sorted maps let every
+    // range find its part of each map with a binary search, and positions never cross ranges
+    if (ok)
+    {
+        for (int t = 0; t < thread_count; t++)
+        {
+            map_sort(&threads[t].map);
+        }
+
+        for (int r = 0; r <= thread_count; r++)
+        {
+            uint64_t key = (UINT64_MAX / thread_count) * r;
+            for (int t = 0; t < thread_count; t++)
+            {
+                const node_map *map = &threads[t].map;
+                bounds[r * thread_count + t] = (r == thread_count) ? map->count : lower_bound(map->slots, map->count, key);
+            }
+        }
+
+        for (started = 0; started < thread_count; started++)
+        {
+            merge_shard *shard = &shards[started];
+            shard->threads = threads;
+            shard->thread_count = thread_count;
+            shard->begin = bounds + started * thread_count;
+            shard->end = bounds + (started + 1) * thread_count;
+            shard->min_games = source->options->min_games;
+            if (pthread_create(&workers[started], NULL, merge_worker, shard) != 0)
+            {
+                break;
+            }
+        }
+
+        ok = started == thread_count;
+        for (int r = 0; r < started; r++)
+        {
+            pthread_join(workers[r], NULL);
+            ok = ok && shards[r].out != NULL;
+        }
+    }
+
+    FILE *file = ok ? fopen(path, "wb") : NULL;
+    if (file != NULL)
+    {
+        uint64_t total = 0;
+        for (int r = 0; r < thread_count; r++)
+        {
+            total += shards[r].count;
+        }
+
+        uint8_t header[OPTREE_HEADER_SIZE];
+        uint32_t version = OPTREE_VERSION;
+        memcpy(header, OPTREE_MAGIC, 4);
+        memcpy(header + 4, &version, sizeof(version));
+        memcpy(header + 8, &total, sizeof(total));
+        ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+        for (int r = 0; r < thread_count && ok; r++)
+        {
+            ok = fwrite(shards[r].out, sizeof(optree_node), shards[r].count, file) == shards[r].count;
+        }
+        ok = (fclose(file) == 0) && ok;
+    }
+    else
+    {
+        ok = false;
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        free(threads[i].map.slots);
+        free(shards[i].out);
+    }
+    free(threads);
+    free(workers);
+    free(bounds);
+    free(shards);
+    return ok;
+}
+
+static void *build_worker(void *arg)
+{
+    build_thread *thread = arg;
+    build_source *source = thread->source;
+    uint max_ply = source->options->max_ply;
+
+    game *g = malloc(sizeof(game));
+    pgn_game *pgn = (source->pgn != NULL) ? malloc(sizeof(pgn_game)) : NULL;
+    thread->ok = g != NULL && (source->pgn == NULL || pgn != NULL) && map_grow(&thread->map);
+
+    while (thread->ok)
+    {
+        if (source->db != NULL)
+        {
+            pthread_mutex_lock(&source->lock);
+            uint64_t first = source->next_game;
+            source->next_game += GAMES_PER_BATCH;
+            pthread_mutex_unlock(&source->lock);
+
+            if (first >= source->db->game_count)
+            {
+                break;
+            }
+
+            uint64_t last = first + GAMES_PER_BATCH;
+            if (last > source->db->game_count)
+            {
+                last = source->db->game_count;
+            }
+
+            for (uint64_t n = first; n < last && thread->ok; n++)
+            {
+                gamedb_game record;
+                if (gamedb_get_game(source->db, n, &record))
+                {
+                    thread->ok = add_game(&thread->map, g, record.fen, record.moves, record.ply_count, record.result, max_ply);
+                }
+            }
+        }
+        else
+        {
+            // The parser is sequential, only reading the next game happens under the lock
+            pthread_mutex_lock(&source->lock);
+            bool have_game = !source->pgn_done && pgn_next_game(source->pgn, pgn);
+            source->pgn_done = !have_game;
+            pthread_mutex_unlock(&source->lock);
+
+            if (!have_game)
+            {
+                break;
+            }
+
+            if (pgn->error)
+            {
+                continue;
+            }
+
+            gamedb_move packed[MAX_MOVES];
+            move_list *history = &pgn->position.move_history;
+            for (uint i = 0; i < history->count; i++)
+            {
+                packed[i] = gamedb_pack_move(history->moves[i]);
+            }
+
+            thread->ok = add_game(&thread->map, g, pgn_get_tag(pgn, "FEN"), packed, history->count, pgn->result, max_ply);
+        }
+    }
+
+    free(g);
+    free(pgn);
+    return NULL;
+}
+
+static bool add_game(node_map *map, game *g, const char *fen, const gamedb_move *moves, uint ply_count, pgn_result result, uint max_ply)
+{
+    if (fen == NULL)
+    {
+        reset_game(g);
+    }
+    else if (!import_FEN(g, fen))
+    {
+        return true; // Skipped, not an error
+    }
+
+    for (uint ply = 0;; ply++)
+    {
+        // A position the game repeats is still only one game reaching it
+        if (repetition_count(g) == 0 && !map_add(map, g->hash, result))
+        {
+            return false;
+        }
+
+        if (ply == ply_count || (max_ply > 0 && ply == max_ply))
+        {
+            return true;
+        }
+
+        // The rest of a corrupt record is left out
+        move m;
+        if (g->move_history.count >= MAX_MOVES || !gamedb_unpack_legal_move(g, moves[ply], &m))
+        {
+            return true;
+        }
+        make_move(g, m);
+    }
+}
+
+static bool map_add(node_map *map, uint64_t key, pgn_result result)
+{
+    if (key == 0)
+    {
+        return true; // Can't be stored, and a real position hashing to 0 is not worth a special case
+    }
+
+    if ((map->count + 1) * 4 > map->capacity * 3 && !map_grow(map))
+    {
+        return false;
+    }
+
+    uint64_t mask = map->capacity - 1;
+    uint64_t i = key & mask;
+    while (map->slots[i].key != 0 && map->slots[i].key != key)
+    {
+        i = (i + 1) & mask;
+    }
+
+    optree_node *node = &map->slots[i];
+    if (node->key == 0)
+    {
+        node->key = key;
+        map->count++;
+    }
+
+    optree_node single = {.key = key, .games = 1};
+    single.white_wins = (result == PgnWhiteWins);
+    single.draws = (result == PgnDraw);
+    single.black_wins = (result == PgnBlackWins);
+    add_stats(node, &single);
+    return true;
+}
+
+static bool map_grow(node_map *map)
+{
+    uint64_t capacity = map->capacity ? map->capacity * 2 : INITIAL_MAP_CAPACITY;
+    optree_node *slots = calloc(capacity, sizeof(optree_node));
+    if (slots == NULL)
+    {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i].key == 0)
+        {
+            continue;
+        }
+
+        uint64_t j = map->slots[i].key & (capacity - 1);
+        while (slots[j].key != 0)
+        {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = map->slots[i];
+    }
+
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+    return true;
+}
+
+// Packs the used slots to the front and sorts them, the map can't be added to afterwards
+static void map_sort(node_map *map)
+{
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < map->capacity; i++)
+    {
+        if (map->slots[i].key != 0)
+        {
+            map->slots[used++] = map->slots[i];
+        }
+    }
+
+    qsort(map->slots, used, sizeof(optree_node), compare_nodes);
+}
+
+static uint64_t lower_bound(const optree_node *nodes, uint64_t count, uint64_t key)
+{
+    uint64_t low = 0, high = count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        if (nodes[mid].key < key)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static void *merge_worker(void *arg)
+{
+    merge_shard *shard = arg;
+
+    uint64_t capacity = 0;
+    for (int t = 0; t < shard->thread_count; t++)
+    {
+        capacity += shard->end[t] - shard->begin[t];
+    }
+
+    uint64_t *heads = malloc(sizeof(uint64_t) * shard->thread_count);
+    shard->out = malloc(sizeof(optree_node) * (capacity > 0 ? capacity : 1));
+    if (heads == NULL || shard->out == NULL)
+    {
+        free(heads);
+        free(shard->out);
+        shard->out = NULL;
+        return NULL;
+    }
+    memcpy(heads, shard->begin, sizeof(uint64_t) * shard->thread_count);
+
+    // Keys are unique within a map, so each map contributes at most one node per key
+    while (true)
+    {
+        int best = -1;
+        for (int t = 0; t < shard->thread_count; t++)
+        {
+            if (heads[t] < shard->end[t] &&
+                (best == -1 || shard->threads[t].map.slots[heads[t]].key < shard->threads[best].map.slots[heads[best]].key))
+            {
+                best = t;
+            }
+        }
+
+        if (best == -1)
+        {
+            break;
+        }
+
+        optree_node node = shard->threads[best].map.slots[heads[best]++];
+        for (int t = 0; t < shard->thread_count; t++)
+        {
+            if (heads[t] < shard->end[t] && shard->threads[t].map.slots[heads[t]].key == node.key)
+            {
+                add_stats(&node, &shard->threads[t].map.slots[heads[t]++]);
+            }
+        }
+
+        if (node.games >= shard->min_games)
+        {
+            shard->out[shard->count++] = node;
+        }
+    }
+
+    free(heads);
+    return NULL;
+}
+
+static void add_stats(optree_node *to, const optree_node *from)
+{
+    to->games += from->games;
+    to->white_wins += from->white_wins;
+    to->draws += from->draws;
+    to->black_wins += from->black_wins;
+}
+
+static int compare_nodes(const void *a, const void *b)
+{
+    const optree_node *x = a, *y = b;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static int compare_children(const void *a, const void *b)
+{
+    const optree_child *x = a, *y = b;
+    return (x->stats.games < y->stats.games) - (x->stats.games > y->stats.games);
+}
@@ -0,0 +1,68 @@
+#ifndef OPTREE_H
+#define OPTREE_H
+
+#include "chess.h"
+#include "gamedb.h"
+#include "mapfile.h"
+#include "pgn.h"
+
+// Opening tree: game results aggregated per position (Zobrist key) over the first plies of many games, little endian:
+//
+//   header      magic "CCOT", u32 version, u64 node count
+//   nodes       optree_node[node count], sorted by key
+//
+// Moves aren't stored, the children of a position are found by playing each legal move and looking up the result,
+// which also merges transpositions for free
+
+#define OPTREE_MAGIC "CCOT"
+#define OPTREE_VERSION 1
+#define OPTREE_MAX_CHILDREN 256
+
+typedef struct
+{
+    uint64_t key;
+    uint32_t games; // Includes games with an unknown result
+    uint32_t white_wins;
+    uint32_t draws;
+    uint32_t black_wins;
+} optree_node;
+
+typedef struct
+{
+    const optree_node *nodes;
+    uint64_t node_count;
+    mapped_file file;
+} optree;
+
+typedef struct
+{
+    move move;
+    optree_node stats;
+} optree_child;
+
+typedef struct
+{
+    int threads;
+    uint max_ply;   // Positions after this many plies are not counted
+    uint min_games; // Positions reached by fewer games are left out of the file
+} optree_options;
+
+// Aggregates every game of a database, work is shared between options->threads threads
+bool optree_build_from_db(const gamedb *db, const char *path, const optree_options *options);
+
+// Same for a PGN stream. Parsing is sequential, replaying and counting runs on all threads.
+// Games with moves that can't be decoded are skipped
+bool optree_build_from_pgn(pgn_reader *reader, const char *path, const optree_options *options);
+
+optree *optree_open(const char *path);
+
+void optree_close(optree *tree);
+
+// NULL if the position is not in the tree
+const optree_node *optree_find(const optree *tree, uint64_t key);
+
+// Legal moves of the position that lead into the tree with their statistics, most played first.
+// The moves are made and undone on game, which is unchanged afterwards
+uint optree_children(const optree *tree, game *game, optree_child *out, uint max_children);
+
+#endif
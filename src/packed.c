@@ -0,0 +1,95 @@
+#include <string.h>
+#include "packed.h"
+
+bool pack_position(game *game, packed_position *out)
+{
+    memset(out, 0, sizeof(packed_position));
+
+    uint count = 0;
+    for (int square = 0; square < 64; square++)
+    {
+        piece_type piece = game->board[square / 8][square % 8];
+        if (piece == EMPTY)
+        {
+            continue;
+        }
+
+        if (count == 32)
+        {
+            return false;
+        }
+
+        out->occupancy |= 1ULL << square;
+        out->pieces[count / 2] |= piece << (4 * (count % 2));
+        count++;
+    }
+
+    out->side_to_move = game->current_turn;
+    out->castling_rights = game->castling_rights;
+    out->en_passant = can_capture_en_passant(game) ? game->en_passant_x + 1 : 0;
+    out->halfmove_clock = (game->halfmove_clock > 0xFFFF) ? 0xFFFF : game->halfmove_clock;
+    out->fullmove_number = (game->fullmove_number > 0xFFFF) ? 0xFFFF : game->fullmove_number;
+    return true;
+}
+
+bool unpack_position(const packed_position *packed, game *out)
+{
+    if (packed->side_to_move > CChessBlack || packed->en_passant > 8 || packed->reserved != 0)
+    {
+        return false;
+    }
+
+    piece_type board[8][8];
+    memset(board, 0, sizeof(board));
+
+    uint count = 0;
+    for (int square = 0; square < 64; square++)
+    {
+        if (!(packed->occupancy & (1ULL << square)))
+        {
+            continue;
+        }
+
+        if (count == 32)
+        {
+            return false;
+        }
+
+        piece_type piece = (packed->pieces[count / 2] >> (4 * (count % 2))) & 15;
+        if (piece == EMPTY)
+        {
+            return false;
+        }
+
+        board[square / 8][square % 8] = piece;
+        count++;
+    }
+
+    // Unused nibbles have to stay zero, or the same position could be packed two ways
+    for (uint i = count; i < 32; i++)
+    {
+        if ((packed->pieces[i / 2] >> (4 * (i % 2))) & 15)
+        {
+            return false;
+        }
+    }
+
+    return set_position(out, board, packed->side_to_move, packed->castling_rights, (int)packed->en_passant - 1,
+                        packed->halfmove_clock, packed->fullmove_number);
+}
+
+bool pack_FEN(const char *fen, packed_position *out, game *scratch)
+{
+    return import_FEN(scratch, fen) && pack_position(scratch, out);
+}
+
+bool unpack_FEN(const packed_position *packed, char *str_buffer, game *scratch)
+{
+    if (!unpack_position(packed, scratch))
+    {
+        return false;
+    }
+
+    export_FEN(scratch, str_buffer);
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "chess.h"
+
+// A position in 32 bytes instead of the whole game struct, for storing positions in bulk.
+// The encoding is canonical: equal positions with equal clocks give byte-identical packings, so they can be compared
+// with memcmp and hashed as raw bytes (zero the clocks first to deduplicate regardless of move counters).
+// The en passant file is only kept if a capture is possible, like in the Zobrist key.
+// Multi-byte fields are little endian, like the other file formats
+
+typedef struct
+{
+    uint64_t occupancy;      // Bit y * 8 + x set for every occupied square
+    uint8_t pieces[16];      // piece_type of each occupied square in square order, two per byte, low nibble first
+    uint8_t side_to_move;    // piece_color
+    uint8_t castling_rights; // castling_right flags
+    uint8_t en_passant;      // File + 1 of a capturable en passant pawn, 0 if there is none
+    uint8_t reserved;        // Always 0
+    uint16_t halfmove_clock;
+    uint16_t fullmove_number;
+} packed_position;
+
+_Static_assert(sizeof(packed_position) == 32, "packed_position must stay 32 bytes");
+
+// Positions with more than 32 pieces can't be packed, which no position reachable from the start has
+bool pack_position(game *game, packed_position *out);
+
+// Validates like import_FEN, the game is untouched on failure. Move history starts empty
+bool unpack_position(const packed_position *packed, game *out);
+
+// FEN conversions go through scratch, which is overwritten. Callers keep one per thread since a game is too big for
+// every platform's default thread stack
+bool pack_FEN(const char *fen, packed_position *out, game *scratch);
+
+// str_buffer needs room for the longest FEN, 90 characters are enough
+bool unpack_FEN(const packed_position *packed, char *str_buffer, game *scratch);
+
+#endif
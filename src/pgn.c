@@ -0,0 +1,428 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pgn.h"
+
+#define PGN_EOF -1
+
+static int next_char(pgn_reader *reader);
+static int peek_char(pgn_reader *reader);
+static void unread_char(pgn_reader *reader, int c);
+static void skip_line(pgn_reader *reader);
+static void skip_comment(pgn_reader *reader);
+static void read_tag(pgn_reader *reader, pgn_game *out);
+static void read_token(pgn_reader *reader, int first, char *token);
+static bool is_token_end(int c);
+static void start_movetext(pgn_game *out);
+
+pgn_reader *pgn_open(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    pgn_reader *reader = pgn_open_file(file);
+    if (reader == NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    reader->owns_file = true;
+    return reader;
+}
+
+pgn_reader *pgn_open_file(FILE *file)
+{
+    pgn_reader *reader = malloc(sizeof(pgn_reader));
+    if (reader == NULL)
+    {
+        return NULL;
+    }
+
+    reader->file = file;
+    reader->owns_file = false;
+    reader->length = 0;
+    reader->pos = 0;
+    reader->at_line_start = true;
+    reader->line = 1;
+    reader->keep_movetext = false;
+    reader->capturing = false;
+    reader->movetext_length = 0;
+    reader->movetext[0] = '\0';
+    return reader;
+}
+
+void pgn_close(pgn_reader *reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+
+    if (reader->owns_file)
+    {
+        fclose(reader->file);
+    }
+    free(reader);
+}
+
+bool pgn_next_game(pgn_reader *reader, pgn_game *out)
+{
+    out->tag_count = 0;
+    out->result = PgnUnknownResult;
+    out->variation_count = 0;
+    out->comment_count = 0;
+    out->error = false;
+    out->error_ply = 0;
+
+    bool has_content = false;
+    bool in_movetext = false;
+    int variation_depth = 0;
+    char token[PGN_MAX_TOKEN];
+
+    reader->capturing = false;
+    reader->movetext_length = 0;
+    reader->captured = 0;
+
+    while (true)
+    {
+        bool line_start = reader->at_line_start;
+        int c = next_char(reader);
+
+        if (c == PGN_EOF)
+        {
+            if (has_content && !in_movetext)
+            {
+                start_movetext(out);
+            }
+            reader->capturing = false;
+            reader->movetext[reader->movetext_length] = '\0';
+            return has_content;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            continue;
+        }
+
+        // A tag after the movetext means the previous game ended without a result
+        if (c == '[' && in_movetext && variation_depth == 0)
+        {
+            unread_char(reader, c);
+            reader->at_line_start = line_start;
+            reader->capturing = false;
+            reader->movetext[reader->movetext_length] = '\0';
+            return true;
+        }
+
+        has_content = true;
+
+        // The movetext starts with the first thing that isn't a tag, from here next_char keeps what it reads
+        if (reader->keep_movetext && c != '[' && !reader->capturing)
+        {
+            reader->capturing = true;
+            reader->movetext[reader->movetext_length++] = c;
+            reader->captured = 1;
+        }
+
+        switch (c)
+        {
+        case '[':
+            // Only a comment came before the tags, it isn't the movetext
+            reader->capturing = false;
+            reader->movetext_length = 0;
+            read_tag(reader, out);
+            break;
+
+        case '{':
+            skip_comment(reader);
+            out->comment_count++;
+            break;
+
+        case ';':
+            skip_line(reader);
+            out->comment_count++;
+            break;
+
+        case '%':
+            // Escape mechanism, only valid in the first column
+            if (line_start)
+            {
+                skip_line(reader);
+            }
+            break;
+
+        case '(':
+            variation_depth++;
+            out->variation_count++;
+            break;
+
+        case ')':
+            if (variation_depth > 0)
+            {
+                variation_depth--;
+            }
+            break;
+
+        case '$':
+            read_token(reader, c, token); // Numeric annotation glyph
+            break;
+
+        default:
+            read_token(reader, c, token);
+
+            if (strcmp(token, "1-0") == 0 || strcmp(token, "0-1") == 0 || strcmp(token, "1/2-1/2") == 0 || strcmp(token, "*") == 0)
+            {
+                if (variation_depth > 0)
+                {
+                    break; // Some programs end variations with a result, it doesn't end the game
+                }
+
+                if (!in_movetext)
+                {
+                    start_movetext(out);
+                }
+
+                // The result is kept in out->result, not in the movetext
+                if (reader->capturing)
+                {
+                    reader->captured -= strlen(token);
+                    reader->movetext_length = (reader->captured < PGN_MAX_MOVETEXT - 1) ? reader->captured
+                                                                                        : PGN_MAX_MOVETEXT - 1;
+                    reader->capturing = false;
+                    reader->movetext[reader->movetext_length] = '\0';
+                }
+
+                out->result = (token[0] == '*') ? PgnUnknownResult : (token[1] == '/') ? PgnDraw
+                                                                   : (token[0] == '1') ? PgnWhiteWins
+                                                                                       : PgnBlackWins;
+                return true;
+            }
+
+            // Move numbers ("12." and "12...") carry no information
+            if (strspn(token, "0123456789.") == strlen(token))
+            {
+                break;
+            }
+
+            if (!in_movetext)
+            {
+                start_movetext(out);
+                in_movetext = true;
+            }
+
+            if (variation_depth > 0 || out->error)
+            {
+                break;
+            }
+
+            // Move numbers glued to the move ("12.e4"), digits only count as one when dots follow, "0-0" is castling
+            char *san = token;
+            size_t digits = strspn(token, "0123456789");
+            if (digits > 0 && token[digits] == '.')
+            {
+                san = token + digits + strspn(token + digits, ".");
+            }
+
+            move m;
+            if (*san == '\0')
+            {
+                break;
+            }
+
+            if (out->position.move_history.count >= MAX_MOVES || !move_from_SAN(&out->position, san, &m))
+            {
+                out->error = true;
+                out->error_ply = out->position.move_history.count;
+                break;
+            }
+
+            make_move(&out->position, m);
+            break;
+        }
+    }
+}
+
+const char *pgn_get_tag(const pgn_game *game, const char *name)
+{
+    for (uint i = 0; i < game->tag_count; i++)
+    {
+        if (strcmp(game->tags[i].name, name) == 0)
+        {
+            return game->tags[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+static int next_char(pgn_reader *reader)
+{
+    if (reader->pos >= reader->length)
+    {
+        reader->length = fread(reader->buffer, 1, PGN_BUFFER_SIZE, reader->file);
+        reader->pos = 0;
+        if (reader->length == 0)
+        {
+            return PGN_EOF;
+        }
+    }
+
+    int c = (unsigned char)reader->buffer[reader->pos++];
+    reader->at_line_start = c == '\n';
+    if (c == '\n')
+    {
+        reader->line++;
+    }
+
+    if (reader->capturing)
+    {
+        if (reader->movetext_length < PGN_MAX_MOVETEXT - 1)
+        {
+            reader->movetext[reader->movetext_length++] = c;
+        }
+        reader->captured++;
+    }
+    return c;
+}
+
+static int peek_char(pgn_reader *reader)
+{
+    int c = next_char(reader);
+    if (c != PGN_EOF)
+    {
+        unread_char(reader, c);
+    }
+    return c;
+}
+
+// Steps back over the character next_char just returned, next_char only refills when the buffer is empty so it's
+// still there
+static void unread_char(pgn_reader *reader, int c)
+{
+    reader->pos--;
+    if (c == '\n')
+    {
+        reader->line--;
+    }
+
+    if (reader->capturing)
+    {
+        reader->captured--;
+        reader->movetext_length = (reader->captured < PGN_MAX_MOVETEXT - 1) ? reader->captured : PGN_MAX_MOVETEXT - 1;
+    }
+}
+
+static void skip_line(pgn_reader *reader)
+{
+    int c;
+    do
+    {
+        c = next_char(reader);
+    } while (c != '\n' && c != PGN_EOF);
+}
+
+static void skip_comment(pgn_reader *reader)
+{
+    int c;
+    do
+    {
+        c = next_char(reader);
+    } while (c != '}' && c != PGN_EOF);
+}
+
+static void read_tag(pgn_reader *reader, pgn_game *out)
+{
+    pgn_tag discarded;
+    pgn_tag *tag = (out->tag_count < PGN_MAX_TAGS) ? &out->tags[out->tag_count] : &discarded;
+    size_t length = 0;
+    int c;
+
+    while ((c = next_char(reader)) == ' ' || c == '\t')
+    {
+    }
+
+    while (c != PGN_EOF && c != ' ' && c != '\t' && c != '"' && c != ']' && c != '\n')
+    {
+        if (length < PGN_MAX_TAG_NAME - 1)
+        {
+            tag->name[length++] = c;
+        }
+        c = next_char(reader);
+    }
+    tag->name[length] = '\0';
+
+    while (c != PGN_EOF && c != '"' && c != ']' && c != '\n')
+    {
+        c = next_char(reader);
+    }
+
+    length = 0;
+    if (c == '"')
+    {
+        while ((c = next_char(reader)) != PGN_EOF && c != '"' && c != '\n')
+        {
+            if (c == '\\')
+            {
+                c = next_char(reader);
+                if (c == PGN_EOF)
+                {
+                    break;
+                }
+            }
+
+            if (length < PGN_MAX_TAG_VALUE - 1)
+            {
+                tag->value[length++] = c;
+            }
+        }
+    }
+    tag->value[length] = '\0';
+
+    while (c != PGN_EOF && c != ']' && c != '\n')
+    {
+        c = next_char(reader);
+    }
+
+    if (tag != &discarded && tag->name[0] != '\0')
+    {
+        out->tag_count++;
+    }
+}
+
+static void read_token(pgn_reader *reader, int first, char *token)
+{
+    size_t length = 0;
+    token[length++] = first;
+
+    while (!is_token_end(peek_char(reader)))
+    {
+        int c = next_char(reader);
+        if (length < PGN_MAX_TOKEN - 1)
+        {
+            token[length++] = c;
+        }
+    }
+    token[length] = '\0';
+}
+
+static bool is_token_end(int c)
+{
+    return c == PGN_EOF || c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+           c == '{' || c == '}' || c == '(' || c == ')' || c == '[' || c == ']' || c == ';' || c == '$';
+}
+
+static void start_movetext(pgn_game *out)
+{
+    const char *fen = pgn_get_tag(out, "FEN");
+    if (fen == NULL || !import_FEN(&out->position, fen))
+    {
+        reset_game(&out->position);
+        if (fen != NULL)
+        {
+            out->error = true; // Moves of an unreadable start position can't be decoded
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include <stdio.h>
+#include "chess.h"
+
+#define PGN_BUFFER_SIZE (64 * 1024)
+#define PGN_MAX_TAGS 32
+#define PGN_MAX_TAG_NAME 32
+#define PGN_MAX_TAG_VALUE 256
+#define PGN_MAX_TOKEN 64
+#define PGN_MAX_MOVETEXT (64 * 1024)
+
+typedef enum
+{
+    PgnUnknownResult, // "*" or no result at all
+    PgnWhiteWins,
+    PgnBlackWins,
+    PgnDraw
+} pgn_result;
+
+typedef struct
+{
+    char name[PGN_MAX_TAG_NAME];
+    char value[PGN_MAX_TAG_VALUE];
+} pgn_tag;
+
+// One game as read from the file. The mainline is replayed into position, so position.move_history holds its moves
+// and position ends up at the final position (the start position comes from the FEN tag if there is one).
+// Everything lives inline and is reused from game to game
+typedef struct
+{
+    pgn_tag tags[PGN_MAX_TAGS];
+    uint tag_count;
+    pgn_result result;
+    game position;
+    uint variation_count;
+    uint comment_count;
+    bool error;    // A move could not be decoded (illegal, ambiguous or too many), later mainline moves are skipped
+    uint error_ply; // Number of mainline moves decoded before the error
+} pgn_game;
+
+typedef struct
+{
+    FILE *file;
+    bool owns_file;
+    char buffer[PGN_BUFFER_SIZE];
+    size_t length;
+    size_t pos;
+    bool at_line_start;
+    unsigned long line;
+
+    // Set keep_movetext to have the movetext of every game kept as written, comments and variations included but
+    // without the result, e.g. to pass on games that can't be decoded. Longer movetext is cut off
+    bool keep_movetext;
+    bool capturing;
+    char movetext[PGN_MAX_MOVETEXT];
+    size_t movetext_length;
+    size_t captured; // Characters since the movetext started, movetext_length stops growing at the limit
+} pgn_reader;
+
+// Opens a PGN file for streaming, returns NULL if it can't be opened. The reader is large, so it is heap allocated
+pgn_reader *pgn_open(const char *path);
+
+// Reads from an already opened file (e.g. stdin), which is not closed by pgn_close
+pgn_reader *pgn_open_file(FILE *file);
+
+void pgn_close(pgn_reader *reader);
+
+// Reads the next game into out, returns false once the file has no more games
+bool pgn_next_game(pgn_reader *reader, pgn_game *out);
+
+// Value of a tag, NULL if the game doesn't have it
+const char *pgn_get_tag(const pgn_game *game, const char *name);
+
+#endif
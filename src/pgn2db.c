@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gamedb.h"
+#include "pgn.h"
+
+// Converts a PGN file into a binary game database:
+//   cchess-pgn2db <input.pgn|-> <output.ccdb>
+// Games with moves that can't be decoded are skipped
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <input.pgn|-> <output.ccdb>\n", argv[0]);
+        return 1;
+    }
+
+    pgn_reader *reader = (strcmp(argv[1], "-") == 0) ? pgn_open_file(stdin) : pgn_open(argv[1]);
+    if (reader == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    gamedb_writer *writer = gamedb_create(argv[2]);
+    if (writer == NULL)
+    {
+        perror(argv[2]);
+        pgn_close(reader);
+        return 1;
+    }
+
+    pgn_game *pgn = malloc(sizeof(pgn_game));
+    unsigned long written = 0, skipped = 0;
+    uint64_t plies = 0;
+    bool ok = true;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (pgn_next_game(reader, pgn))
+    {
+        if (pgn->error)
+        {
+            skipped++;
+            continue;
+        }
+
+        if (!gamedb_write_game(writer, pgn_get_tag(pgn, "FEN"), &pgn->position.move_history, pgn->result))
+        {
+            fprintf(stderr, "Failed to write game %lu\n", written + skipped + 1);
+            ok = false;
+            break;
+        }
+
+        written++;
+        plies += pgn->position.move_history.count;
+    }
+
+    ok = gamedb_finish(writer) && ok;
+    pgn_close(reader);
+    free(pgn);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "games: %lu written, %lu skipped, %llu plies, %.3f s\n", written, skipped, (unsigned long long)plies, elapsed);
+    return ok ? 0 : 1;
+}
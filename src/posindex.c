@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "posindex.h"
+
+#define POSINDEX_HEADER_SIZE 16
+
+typedef struct
+{
+    const gamedb *db;
+    uint64_t first_game;
+    uint64_t last_game; // Exclusive
+    uint max_ply;
+    posindex_entry *entries;
+    uint64_t count;
+    bool ok;
+} build_shard;
+
+static void *build_worker(void *arg);
+static int compare_entries(const void *a, const void *b);
+static int compare_stats(const void *a, const void *b);
+
+bool posindex_build(const gamedb *db, const char *path, int threads, uint max_ply)
+{
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+
+    // Every thread replays a contiguous range of games and sorts its own entries, the sorted runs are merged at the end
+    build_shard *shards = calloc(threads, sizeof(build_shard));
+    pthread_t *workers = malloc(sizeof(pthread_t) * threads);
+    if (shards == NULL || workers == NULL)
+    {
+        free(shards);
+        free(workers);
+        return false;
+    }
+
+    int started = 0;
+    for (; started < threads; started++)
+    {
+        build_shard *shard = &shards[started];
+        shard->db = db;
+        shard->first_game = db->game_count * started / threads;
+        shard->last_game = db->game_count * (started + 1) / threads;
+        shard->max_ply = max_ply;
+        if (pthread_create(&workers[started], NULL, build_worker, shard) != 0)
+        {
+            break;
+        }
+    }
+
+    // The games of a shard without a thread are missing, so the index can't be written
+    bool ok = started == threads;
+    uint64_t total = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+        ok = ok && shards[i].ok;
+        total += shards[i].count;
+    }
+
+    FILE *file = ok ? fopen(path, "wb") : NULL;
+    if (file != NULL)
+    {
+        uint8_t header[POSINDEX_HEADER_SIZE];
+        uint32_t version = POSINDEX_VERSION;
+        memcpy(header, POSINDEX_MAGIC, 4);
+        memcpy(header + 4, &version, sizeof(version));
+        memcpy(header + 8, &total, sizeof(total));
+        ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+        // K-way merge, the number of runs is the thread count so a linear scan for the smallest head is enough
+        uint64_t *heads = calloc(threads, sizeof(uint64_t));
+        posindex_entry buffer[4096];
+        size_t buffered = 0;
+
+        while (ok && heads != NULL)
+        {
+            int best = -1;
+            for (int i = 0; i < threads; i++)
+            {
+                if (heads[i] < shards[i].count &&
+                    (best == -1 || compare_entries(&shards[i].entries[heads[i]], &shards[best].entries[heads[best]]) < 0))
+                {
+                    best = i;
+                }
+            }
+
+            if (best == -1 || buffered == sizeof(buffer) / sizeof(buffer[0]))
+            {
+                ok = fwrite(buffer, sizeof(posindex_entry), buffered, file) == buffered;
+                buffered = 0;
+                if (best == -1)
+                {
+                    break;
+                }
+            }
+
+            buffer[buffered++] = shards[best].entries[heads[best]++];
+        }
+
+        ok = ok && heads != NULL;
+        free(heads);
+        ok = (fclose(file) == 0) && ok;
+    }
+    else
+    {
+        ok = false;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        free(shards[i].entries);
+    }
+    free(shards);
+    free(workers);
+    return ok;
+}
+
+posindex *posindex_open(const char *path)
+{
+    posindex *index = calloc(1, sizeof(posindex));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+
+    if (!map_file(path, &index->file))
+    {
+        free(index);
+        return NULL;
+    }
+
+    uint32_t version;
+    const uint8_t *data = index->file.data;
+    if (index->file.size < POSINDEX_HEADER_SIZE || memcmp(data, POSINDEX_MAGIC, 4) != 0)
+    {
+        posindex_close(index);
+        return NULL;
+    }
+
+    memcpy(&version, data + 4, sizeof(version));
+    memcpy(&index->entry_count, data + 8, sizeof(index->entry_count));
+
+    if (version != POSINDEX_VERSION ||
+        index->entry_count > (index->file.size - POSINDEX_HEADER_SIZE) / sizeof(posindex_entry))
+    {
+        posindex_close(index);
+        return NULL;
+    }
+
+    index->entries = (const posindex_entry *)(data + POSINDEX_HEADER_SIZE);
+    return index;
+}
+
+void posindex_close(posindex *index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+
+    unmap_file(&index->file);
+    free(index);
+}
+
+uint64_t posindex_find(const posindex *index, uint64_t key, const posindex_entry **first)
+{
+    // Lower bound of the key
+    uint64_t low = 0, high = index->entry_count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        if (index->entries[mid].key < key)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    uint64_t end = low;
+    while (end < index->entry_count && index->entries[end].key == key)
+    {
+        end++;
+    }
+
+    *first = index->entries + low;
+    return end - low;
+}
+
+uint posindex_next_moves(const posindex *index, uint64_t key, posindex_move_stat *out, uint max_stats)
+{
+    const posindex_entry *entries;
+    uint64_t count = posindex_find(index, key, &entries);
+    uint stat_count = 0;
+
+    // Positions rarely have more than a few dozen different continuations, a linear search is fine
+    for (uint64_t i = 0; i < count; i++)
+    {
+        gamedb_move next = entries[i].next_move;
+        if (next == POSINDEX_NO_MOVE)
+        {
+            continue;
+        }
+
+        uint s = 0;
+        while (s < stat_count && out[s].move != next)
+        {
+            s++;
+        }
+
+        if (s == stat_count)
+        {
+            if (stat_count == max_stats)
+            {
+                continue;
+            }
+            out[stat_count++] = (posindex_move_stat){.move = next, .count = 0};
+        }
+        out[s].count++;
+    }
+
+    qsort(out, stat_count, sizeof(posindex_move_stat), compare_stats);
+    return stat_count;
+}
+
+static void *build_worker(void *arg)
+{
+    build_shard *shard = arg;
+    uint64_t capacity = 0;
+    game *g = malloc(sizeof(game));
+
+    shard->ok = g != NULL;
+
+    for (uint64_t n = shard->first_game; n < shard->last_game && shard->ok; n++)
+    {
+        gamedb_game record;
+        if (!gamedb_get_game(shard->db, n, &record))
+        {
+            continue;
+        }
+
+        if (record.fen == NULL)
+        {
+            reset_game(g);
+        }
+        else if (!import_FEN(g, record.fen))
+        {
+            continue;
+        }
+
+        uint plies = record.ply_count;
+        if (shard->max_ply > 0 && plies > shard->max_ply)
+        {
+            plies = shard->max_ply;
+        }
+
+        if (shard->count + plies + 1 > capacity)
+        {
+            capacity = (capacity + plies + 1) * 2;
+            posindex_entry *entries = realloc(shard->entries, capacity * sizeof(posindex_entry));
+            if (entries == NULL)
+            {
+                shard->ok = false;
+                break;
+            }
+            shard->entries = entries;
+        }
+
+        for (uint ply = 0; ply <= plies; ply++)
+        {
+            // A corrupt record ends at its first illegal move, so the index only holds moves that can be played
+            gamedb_move next = (ply < record.ply_count) ? record.moves[ply] : POSINDEX_NO_MOVE;
+            move m;
+            bool legal = next != POSINDEX_NO_MOVE && g->move_history.count < MAX_MOVES &&
+                         gamedb_unpack_legal_move(g, next, &m);
+            shard->entries[shard->count++] = (posindex_entry){
+                .key = g->hash, .game = (uint32_t)n, .ply = ply, .next_move = legal ? next : POSINDEX_NO_MOVE};
+
+            if (ply == plies || !legal)
+            {
+                break;
+            }
+            make_move(g, m);
+        }
+    }
+
+    if (shard->ok)
+    {
+        qsort(shard->entries, shard->count, sizeof(posindex_entry), compare_entries);
+    }
+
+    free(g);
+    return NULL;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const posindex_entry *x = a, *y = b;
+    if (x->key != y->key)
+    {
+        return (x->key < y->key) ? -1 : 1;
+    }
+    if (x->game != y->game)
+    {
+        return (x->game < y->game) ? -1 : 1;
+    }
+    return (x->ply > y->ply) - (x->ply < y->ply);
+}
+
+static int compare_stats(const void *a, const void *b)
+{
+    const posindex_move_stat *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
@@ -0,0 +1,54 @@
+#ifndef POSINDEX_H
+#define POSINDEX_H
+
+#include "chess.h"
+#include "gamedb.h"
+#include "mapfile.h"
+
+// Index from Zobrist key to every (game, ply) of a game database that reached the position, little endian:
+//
+//   header      magic "CCPI", u32 version, u64 entry count
+//   entries     posindex_entry[entry count], sorted by key, then game, then ply
+//
+// The file is mapped and searched in place, a lookup is one binary search
+
+#define POSINDEX_MAGIC "CCPI"
+#define POSINDEX_VERSION 1
+#define POSINDEX_NO_MOVE 0 // next_move of a game's final position, a1-a1 is never a real move
+
+typedef struct
+{
+    uint64_t key;
+    uint32_t game;
+    uint16_t ply;       // Moves played before the position was reached
+    gamedb_move next_move; // Move played from the position in that game
+} posindex_entry;
+
+typedef struct
+{
+    const posindex_entry *entries;
+    uint64_t entry_count;
+    mapped_file file;
+} posindex;
+
+typedef struct
+{
+    gamedb_move move;
+    uint count;
+} posindex_move_stat;
+
+// Replays every game of the database on the given number of threads and writes the sorted index.
+// max_ply limits how deep into each game positions are indexed, 0 for no limit
+bool posindex_build(const gamedb *db, const char *path, int threads, uint max_ply);
+
+posindex *posindex_open(const char *path);
+
+void posindex_close(posindex *index);
+
+// All entries of a position, sets *first and returns how many there are
+uint64_t posindex_find(const posindex *index, uint64_t key, const posindex_entry **first);
+
+// Moves played from a position and how often, most played first. Returns the number of distinct moves written
+uint posindex_next_moves(const posindex *index, uint64_t key, posindex_move_stat *out, uint max_stats);
+
+#endif
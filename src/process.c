@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "process.h"
+#include "util.h"
+
+#define PROCESS_BUFFER_SIZE 8192
+#define PROCESS_EXIT_GRACE 2.0 // Seconds a process gets to exit after its stdin is closed
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+struct process
+{
+#ifdef _WIN32
+    HANDLE process;
+    HANDLE input;  // Child's stdin
+    HANDLE output; // Child's stdout
+#else
+    pid_t pid;
+    int input;
+    int output;
+#endif
+    char buffer[PROCESS_BUFFER_SIZE];
+    size_t length;
+    bool closed;
+};
+
+static int read_some(process *p, double timeout);
+static bool write_all(process *p, const char *data, size_t size);
+#ifndef _WIN32
+static bool make_pipe(int fds[2]);
+#endif
+
+bool process_write_line(process *p, const char *line)
+{
+    return write_all(p, line, strlen(line)) && write_all(p, "\n", 1);
+}
+
+bool process_read_line(process *p, char *line, size_t size, double timeout)
+{
+    double deadline = now_seconds() + timeout;
+
+    while (true)
+    {
+        char *newline = memchr(p->buffer, '\n', p->length);
+
+        // A line longer than the buffer is split rather than blocking forever
+        if (newline != NULL || p->length == sizeof(p->buffer))
+        {
+            size_t line_length = (newline != NULL) ? (size_t)(newline - p->buffer) : p->length;
+            size_t consumed = (newline != NULL) ? line_length + 1 : line_length;
+
+            if (line_length > 0 && p->buffer[line_length - 1] == '\r')
+            {
+                line_length--;
+            }
+
+            size_t copied = (line_length < size - 1) ? line_length : size - 1;
+            memcpy(line, p->buffer, copied);
+            line[copied] = '\0';
+
+            memmove(p->buffer, p->buffer + consumed, p->length - consumed);
+            p->length -= consumed;
+            return true;
+        }
+
+        if (p->closed)
+        {
+            return false;
+        }
+
+        double remaining = (timeout < 0) ? -1 : deadline - now_seconds();
+        if (timeout >= 0 && remaining <= 0)
+        {
+            return false;
+        }
+
+        int result = read_some(p, remaining);
+        if (result < 0)
+        {
+            p->closed = true;
+        }
+        else if (result == 0 && timeout >= 0 && now_seconds() >= deadline)
+        {
+            return false;
+        }
+    }
+}
+
+#ifdef _WIN32
+
+process *process_start(const char *command)
+{
+    process *p = calloc(1, sizeof(process));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+
+    SECURITY_ATTRIBUTES inherit = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+    HANDLE child_input, child_output;
+    if (!CreatePipe(&child_input, &p->input, &inherit, 0) || !CreatePipe(&p->output, &child_output, &inherit, 0))
+    {
+        free(p);
+        return NULL;
+    }
+
+    // Only the child's ends are inherited
+    SetHandleInformation(p->input, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(p->output, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA startup = {0};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = child_input;
+    startup.hStdOutput = child_output;
+    startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    char *command_line = _strdup(command); // CreateProcess may modify it
+    PROCESS_INFORMATION info;
+    BOOL started = command_line != NULL &&
+                   CreateProcessA(NULL, command_line, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &info);
+    free(command_line);
+    CloseHandle(child_input);
+    CloseHandle(child_output);
+
+    if (!started)
+    {
+        CloseHandle(p->input);
+        CloseHandle(p->output);
+        free(p);
+        return NULL;
+    }
+
+    CloseHandle(info.hThread);
+    p->process = info.hProcess;
+    return p;
+}
+
+void process_stop(process *p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+
+    CloseHandle(p->input);
+    if (WaitForSingleObject(p->process, (DWORD)(PROCESS_EXIT_GRACE * 1000)) != WAIT_OBJECT_0)
+    {
+        TerminateProcess(p->process, 1);
+        WaitForSingleObject(p->process, INFINITE);
+    }
+    CloseHandle(p->output);
+    CloseHandle(p->process);
+    free(p);
+}
+
+// Anonymous pipes can't be waited on, so poll for available data
+static int read_some(process *p, double timeout)
+{
+    double deadline = now_seconds() + timeout;
+
+    while (true)
+    {
+        DWORD available = 0;
+        if (!PeekNamedPipe(p->output, NULL, 0, NULL, &available, NULL))
+        {
+            return -1;
+        }
+
+        if (available > 0)
+        {
+            DWORD space = (DWORD)(sizeof(p->buffer) - p->length);
+            DWORD read = 0;
+            if (!ReadFile(p->output, p->buffer + p->length, (available < space) ? available : space, &read, NULL))
+            {
+                return -1;
+            }
+            p->length += read;
+            return (int)read;
+        }
+
+        if (timeout >= 0 && now_seconds() >= deadline)
+        {
+            return 0;
+        }
+        Sleep(1);
+    }
+}
+
+static bool write_all(process *p, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(p->input, data, (DWORD)size, &written, NULL))
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+#else
+
+// Held from creating a child's pipes until they are close-on-exec, so a child forked by another thread meanwhile
+// can't inherit them. An inherited write end would keep a pipe open after its own process died
+static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+process *process_start(const char *command)
+{
+    process *p = calloc(1, sizeof(process));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+
+    int to_child[2], from_child[2];
+    pthread_mutex_lock(&spawn_lock);
+    if (!make_pipe(to_child))
+    {
+        pthread_mutex_unlock(&spawn_lock);
+        free(p);
+        return NULL;
+    }
+
+    if (!make_pipe(from_child))
+    {
+        pthread_mutex_unlock(&spawn_lock);
+        close(to_child[0]);
+        close(to_child[1]);
+        free(p);
+        return NULL;
+    }
+
+    // A dead child must show up as a failed write, not kill the whole program
+    signal(SIGPIPE, SIG_IGN);
+
+    // dup2 clears close-on-exec, so the child keeps only its stdin and stdout
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    pthread_mutex_unlock(&spawn_lock);
+    close(to_child[0]);
+    close(from_child[1]);
+
+    if (pid < 0)
+    {
+        close(to_child[1]);
+        close(from_child[0]);
+        free(p);
+        return NULL;
+    }
+
+    p->pid = pid;
+    p->input = to_child[1];
+    p->output = from_child[0];
+    return p;
+}
+
+void process_stop(process *p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+
+    close(p->input);
+
+    double deadline = now_seconds() + PROCESS_EXIT_GRACE;
+    while (waitpid(p->pid, NULL, WNOHANG) == 0)
+    {
+        if (now_seconds() >= deadline)
+        {
+            kill(p->pid, SIGKILL);
+            waitpid(p->pid, NULL, 0);
+            break;
+        }
+        usleep(1000);
+    }
+
+    close(p->output);
+    free(p);
+}
+
+static int read_some(process *p, double timeout)
+{
+    struct pollfd fd = {.fd = p->output, .events = POLLIN};
+    int ready = poll(&fd, 1, (timeout < 0) ? -1 : (int)(timeout * 1000) + 1);
+    if (ready <= 0)
+    {
+        return 0;
+    }
+
+    ssize_t count = read(p->output, p->buffer + p->length, sizeof(p->buffer) - p->length);
+    if (count <= 0)
+    {
+        return -1;
+    }
+
+    p->length += count;
+    return (int)count;
+}
+
+static bool write_all(process *p, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(p->input, data, size);
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool make_pipe(int fds[2])
+{
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A child process talked to line by line over its stdin and stdout, e.g. a UCI engine
+
+typedef struct process process;
+
+// Runs the command through the shell, returns NULL if it can't be started
+process *process_start(const char *command);
+
+// Writes one line, the newline is added. False once the process is gone
+bool process_write_line(process *p, const char *line);
+
+// Reads one line without its newline. Waits at most timeout seconds, a negative timeout waits forever.
+// False on timeout or once the process has closed its output
+bool process_read_line(process *p, char *line, size_t size, double timeout);
+
+// Closes the pipes and waits for the process, killing it if it doesn't exit on its own
+void process_stop(process *p);
+
+#endif
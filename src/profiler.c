@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include "profiler.h"
+
+static profiler_percentiles percentiles_of(double *values, int count);
+static int compare_doubles(const void *a, const void *b);
+static double percentile(const double *sorted, int count, double fraction);
+
+void profiler_add(frame_profiler *profiler, const frame_sample *sample)
+{
+    profiler->samples[profiler->next] = *sample;
+    profiler->next = (profiler->next + 1) % PROFILER_FRAMES;
+    if (profiler->count < PROFILER_FRAMES)
+    {
+        profiler->count++;
+    }
+}
+
+// Order doesn't matter for any of the numbers, so the ring is read from slot 0 up
+profiler_summary profiler_summarize(const frame_profiler *profiler)
+{
+    profiler_summary summary = {0};
+    summary.frames = profiler->count;
+    if (profiler->count == 0)
+    {
+        return summary;
+    }
+
+    double values[PROFILER_FRAMES];
+    double valid_moves_time = 0;
+    double game_over_time = 0;
+
+    for (int i = 0; i < profiler->count; i++)
+    {
+        const frame_sample *sample = &profiler->samples[i];
+        summary.valid_moves_calls += sample->valid_moves_calls;
+        summary.game_over_calls += sample->game_over_calls;
+        valid_moves_time += sample->valid_moves_time;
+        game_over_time += sample->game_over_time;
+        summary.valid_moves_max =
+            (sample->valid_moves_time > summary.valid_moves_max) ? sample->valid_moves_time : summary.valid_moves_max;
+        summary.game_over_max =
+            (sample->game_over_time > summary.game_over_max) ? sample->game_over_time : summary.game_over_max;
+    }
+    summary.valid_moves_mean = summary.valid_moves_calls ? valid_moves_time / summary.valid_moves_calls : 0;
+    summary.game_over_mean = summary.game_over_calls ? game_over_time / summary.game_over_calls : 0;
+
+    for (int i = 0; i < profiler->count; i++)
+    {
+        values[i] = profiler->samples[i].frame_time;
+    }
+    summary.frame_time = percentiles_of(values, profiler->count);
+
+    for (int i = 0; i < profiler->count; i++)
+    {
+        values[i] = profiler->samples[i].work_time;
+    }
+    summary.work_time = percentiles_of(values, profiler->count);
+
+    for (int i = 0; i < profiler->count; i++)
+    {
+        values[i] = profiler->samples[i].draw_calls;
+    }
+    summary.draw_calls = percentiles_of(values, profiler->count);
+
+    return summary;
+}
+
+// Sorts values in place
+static profiler_percentiles percentiles_of(double *values, int count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+    return (profiler_percentiles){percentile(values, count, 0.5), percentile(values, count, 0.9),
+                                  percentile(values, count, 0.99), values[count - 1]};
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear interpolation between the two closest ranks
+static double percentile(const double *sorted, int count, double fraction)
+{
+    double rank = fraction * (count - 1);
+    int lower = (int)rank;
+    int upper = (lower + 1 < count) ? lower + 1 : lower;
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - lower);
+}
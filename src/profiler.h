@@ -0,0 +1,51 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler behind the GUI's overlay: one sample per frame in a ring buffer, summarized over the last
+// PROFILER_FRAMES frames. Has no raylib dependency, the caller takes the times
+
+#define PROFILER_FRAMES 240 // Four seconds at 60 frames per second
+
+typedef struct
+{
+    double frame_time; // Seconds from the start of the previous frame to the start of this one
+    double work_time;  // Seconds spent on this frame before handing it to EndDrawing, without vsync or idle waits
+    double valid_moves_time;
+    double game_over_time;
+    int valid_moves_calls;
+    int game_over_calls;
+    int draw_calls;
+} frame_sample;
+
+typedef struct
+{
+    frame_sample samples[PROFILER_FRAMES];
+    int next;  // Slot the next sample goes into
+    int count; // Filled slots
+} frame_profiler;
+
+typedef struct
+{
+    double p50, p90, p99, max;
+} profiler_percentiles;
+
+typedef struct
+{
+    int frames;
+    profiler_percentiles frame_time;
+    profiler_percentiles work_time;
+    profiler_percentiles draw_calls;
+    int valid_moves_calls;
+    double valid_moves_mean; // Seconds per call, 0 without calls
+    double valid_moves_max;  // Most seconds spent in one frame
+    int game_over_calls;
+    double game_over_mean;
+    double game_over_max;
+} profiler_summary;
+
+// Overwrites the oldest sample once the buffer is full
+void profiler_add(frame_profiler *profiler, const frame_sample *sample);
+
+profiler_summary profiler_summarize(const frame_profiler *profiler);
+
+#endif
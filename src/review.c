@@ -0,0 +1,309 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "review.h"
+#include "util.h"
+
+// Expected score lost by a move from which on it counts, roughly the win chance thresholds common review tools use
+#define INACCURACY_LOSS 0.05
+#define MISTAKE_LOSS 0.10
+#define BLUNDER_LOSS 0.15
+#define EXPECTED_SCORE_SCALE 0.00368208 // Of the logistic curve, a pawn up is about a 59% expected score
+
+typedef struct
+{
+    reviewer *reviewer;
+    pthread_t thread;
+    search_context *search;
+    atomic_bool stop;    // Set when the game is replaced, cleared under the lock when a position is taken
+    uint64_t generation; // Game the copies below belong to
+    game position;       // Moved through the game with make_move and undo_last_move
+    move_list moves;
+} review_worker;
+
+struct reviewer
+{
+    review_options options;
+    review_worker *workers;
+    int worker_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // A game came in or the threads should quit
+    pthread_cond_t progress; // A position was searched
+    bool quit;
+
+    // Guarded by lock
+    uint64_t generation; // Counts games, results for an older one are dropped
+    game start;          // Position before the first move
+    move_list moves;
+    uint position_count; // Moves + 1, the position after the last move is searched too
+    uint next_position;
+    uint searched;
+    int scores[MAX_MOVES + 1]; // From the view of the side to move
+    move best[MAX_MOVES + 1];
+    bool position_done[MAX_MOVES + 1];
+};
+
+static void *review_thread(void *arg);
+static bool same_move(move a, move b);
+
+reviewer *review_create(const review_options *options)
+{
+    reviewer *reviewer = calloc(1, sizeof(struct reviewer));
+    if (reviewer == NULL)
+    {
+        return NULL;
+    }
+
+    reviewer->options = *options;
+    int count = (options->threads > 0) ? options->threads : cpu_count();
+    reviewer->workers = calloc(count, sizeof(review_worker));
+    if (reviewer->workers == NULL)
+    {
+        free(reviewer);
+        return NULL;
+    }
+
+    pthread_mutex_init(&reviewer->lock, NULL);
+    pthread_cond_init(&reviewer->work, NULL);
+    pthread_cond_init(&reviewer->progress, NULL);
+
+    for (int i = 0; i < count; i++)
+    {
+        review_worker *worker = &reviewer->workers[i];
+        worker->reviewer = reviewer;
+        atomic_init(&worker->stop, false);
+        worker->search = search_create(options->hash_megabytes);
+        if (worker->search == NULL || pthread_create(&worker->thread, NULL, review_thread, worker) != 0)
+        {
+            search_destroy(worker->search);
+            break;
+        }
+        reviewer->worker_count++;
+    }
+
+    if (reviewer->worker_count < count)
+    {
+        review_destroy(reviewer);
+        return NULL;
+    }
+
+    return reviewer;
+}
+
+void review_destroy(reviewer *reviewer)
+{
+    if (reviewer == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&reviewer->lock);
+    reviewer->quit = true;
+    for (int i = 0; i < reviewer->worker_count; i++)
+    {
+        atomic_store(&reviewer->workers[i].stop, true);
+    }
+    pthread_cond_broadcast(&reviewer->work);
+    pthread_mutex_unlock(&reviewer->lock);
+
+    for (int i = 0; i < reviewer->worker_count; i++)
+    {
+        pthread_join(reviewer->workers[i].thread, NULL);
+        search_destroy(reviewer->workers[i].search);
+    }
+
+    pthread_cond_destroy(&reviewer->progress);
+    pthread_cond_destroy(&reviewer->work);
+    pthread_mutex_destroy(&reviewer->lock);
+    free(reviewer->workers);
+    free(reviewer);
+}
+
+void review_start(reviewer *reviewer, const game *game)
+{
+    pthread_mutex_lock(&reviewer->lock);
+
+    // Taking back every move gives the start position, also for games that began from a FEN
+    reviewer->start = *game;
+    reviewer->moves = game->move_history;
+    while (reviewer->start.move_history.count > 0)
+    {
+        undo_last_move(&reviewer->start);
+    }
+    reviewer->start.status = InProgress;
+
+    reviewer->generation++;
+    reviewer->position_count = game->move_history.count + 1;
+    reviewer->next_position = 0;
+    reviewer->searched = 0;
+    for (uint i = 0; i < reviewer->position_count; i++)
+    {
+        reviewer->position_done[i] = false;
+    }
+
+    for (int i = 0; i < reviewer->worker_count; i++)
+    {
+        atomic_store(&reviewer->workers[i].stop, true);
+    }
+    pthread_cond_broadcast(&reviewer->work);
+    pthread_cond_broadcast(&reviewer->progress);
+    pthread_mutex_unlock(&reviewer->lock);
+}
+
+void review_stop(reviewer *reviewer)
+{
+    pthread_mutex_lock(&reviewer->lock);
+    reviewer->generation++;
+    reviewer->position_count = 0;
+    reviewer->next_position = 0;
+    reviewer->searched = 0;
+    for (int i = 0; i < reviewer->worker_count; i++)
+    {
+        atomic_store(&reviewer->workers[i].stop, true);
+    }
+    pthread_cond_broadcast(&reviewer->progress);
+    pthread_mutex_unlock(&reviewer->lock);
+}
+
+bool review_poll(reviewer *reviewer, ply_review *out, uint *done_count)
+{
+    if (pthread_mutex_trylock(&reviewer->lock) != 0)
+    {
+        return false;
+    }
+
+    *done_count = 0;
+    for (uint i = 0; i + 1 < reviewer->position_count; i++)
+    {
+        ply_review *review = &out[i];
+        *review = (ply_review){.played = reviewer->moves.moves[i]};
+        if (!reviewer->position_done[i] || !reviewer->position_done[i + 1])
+        {
+            continue;
+        }
+
+        review->done = true;
+        review->best = reviewer->best[i];
+        review->score_before = reviewer->scores[i];
+        review->score_after = -reviewer->scores[i + 1];
+
+        // Playing the engine's move loses nothing, even if the next search, one ply further on, scores it differently
+        double loss = review_expected_score(review->score_before) - review_expected_score(review->score_after);
+        review->loss = (same_move(review->played, review->best) || loss < 0) ? 0 : loss;
+        review->grade = (review->loss >= BLUNDER_LOSS)      ? ReviewBlunder
+                        : (review->loss >= MISTAKE_LOSS)    ? ReviewMistake
+                        : (review->loss >= INACCURACY_LOSS) ? ReviewInaccuracy
+                                                            : ReviewGood;
+        (*done_count)++;
+    }
+
+    pthread_mutex_unlock(&reviewer->lock);
+    return true;
+}
+
+void review_wait(reviewer *reviewer)
+{
+    pthread_mutex_lock(&reviewer->lock);
+    while (reviewer->searched < reviewer->position_count)
+    {
+        pthread_cond_wait(&reviewer->progress, &reviewer->lock);
+    }
+    pthread_mutex_unlock(&reviewer->lock);
+}
+
+const char *review_grade_suffix(review_grade grade)
+{
+    switch (grade)
+    {
+    case ReviewInaccuracy:
+        return "?!";
+    case ReviewMistake:
+        return "?";
+    case ReviewBlunder:
+        return "??";
+    default:
+        return "";
+    }
+}
+
+// Logistic curve, mates go to 0 or 1
+double review_expected_score(int score)
+{
+    return 1 / (1 + exp(-EXPECTED_SCORE_SCALE * score));
+}
+
+void review_format_score(int score, char *text, size_t size)
+{
+    if (abs(score) >= SEARCH_MATE - SEARCH_MAX_PLY)
+    {
+        int moves = (SEARCH_MATE - abs(score) + 1) / 2;
+        snprintf(text, size, "%s#%d", score > 0 ? "" : "-", moves);
+        return;
+    }
+    snprintf(text, size, "%+.2f", score / 100.0);
+}
+
+static void *review_thread(void *arg)
+{
+    review_worker *worker = arg;
+    reviewer *reviewer = worker->reviewer;
+
+    pthread_mutex_lock(&reviewer->lock);
+    while (true)
+    {
+        while (!reviewer->quit && reviewer->next_position >= reviewer->position_count)
+        {
+            pthread_cond_wait(&reviewer->work, &reviewer->lock);
+        }
+        if (reviewer->quit)
+        {
+            break;
+        }
+
+        uint index = reviewer->next_position++;
+        uint64_t generation = reviewer->generation;
+        if (worker->generation != generation)
+        {
+            worker->position = reviewer->start;
+            worker->moves = reviewer->moves;
+            worker->generation = generation;
+        }
+        atomic_store(&worker->stop, false);
+        pthread_mutex_unlock(&reviewer->lock);
+
+        // Positions are handed out in order, so this is usually a single move forward
+        game *position = &worker->position;
+        while (position->move_history.count > index)
+        {
+            undo_last_move(position);
+        }
+        while (position->move_history.count < index)
+        {
+            make_move(position, worker->moves.moves[position->move_history.count]);
+        }
+
+        search_limits limits = {.depth = reviewer->options.depth, .nodes = reviewer->options.nodes, .stop = &worker->stop};
+        search_result result = search_run(worker->search, position, &limits, NULL, NULL);
+
+        pthread_mutex_lock(&reviewer->lock);
+        if (generation == reviewer->generation)
+        {
+            reviewer->scores[index] = result.score;
+            reviewer->best[index] = result.best_move;
+            reviewer->position_done[index] = true;
+            reviewer->searched++;
+            pthread_cond_broadcast(&reviewer->progress);
+        }
+    }
+    pthread_mutex_unlock(&reviewer->lock);
+
+    return NULL;
+}
+
+static bool same_move(move a, move b)
+{
+    return a.x_from == b.x_from && a.y_from == b.y_from && a.x_to == b.x_to && a.y_to == b.y_to &&
+           a.promotion_piece == b.promotion_piece;
+}
@@ -0,0 +1,68 @@
+#ifndef REVIEW_H
+#define REVIEW_H
+
+#include "chess.h"
+#include "search.h"
+
+// Game review: every position of a game is searched to a fixed depth or node count on a pool of threads, and every
+// move is graded by how much of the expected score it gave away compared to the engine's choice. Positions are handed
+// out in order and results can be polled while the rest is still being searched
+
+typedef enum
+{
+    ReviewGood,
+    ReviewInaccuracy, // ?!
+    ReviewMistake,    // ?
+    ReviewBlunder     // ??
+} review_grade;
+
+typedef struct
+{
+    bool done;         // Both positions around the move are searched, nothing below is valid before
+    move played;
+    move best;         // Engine's choice in the position before the move
+    int score_before;  // Centipawns of the position before the move, from the view of the side that moved
+    int score_after;   // Of the position after it, from the same view
+    double loss;       // Expected score given away, 0 (none) to 1 (a won position turned into a lost one)
+    review_grade grade;
+} ply_review;
+
+typedef struct
+{
+    int threads;           // 0 for one per core
+    int depth;             // Per position, used when nodes is 0
+    uint64_t nodes;        // Per position, 0 to search to depth instead
+    size_t hash_megabytes; // Per thread
+} review_options;
+
+typedef struct reviewer reviewer;
+
+// Starts the threads, which wait for a game. NULL if they or their search contexts couldn't be created
+reviewer *review_create(const review_options *options);
+
+void review_destroy(reviewer *reviewer);
+
+// Reviews every move in the game's history, the game is copied. A review that is still running is abandoned
+void review_start(reviewer *reviewer, const game *game);
+
+// Abandons the current review, the threads wait for the next game
+void review_stop(reviewer *reviewer);
+
+// Copies the review of every move of the current game into out, which needs room for one per move. Moves that aren't
+// done yet have done false. Returns false and leaves out alone if a thread holds the lock at the moment
+bool review_poll(reviewer *reviewer, ply_review *out, uint *done_count);
+
+// Waits until every move of the current game is reviewed
+void review_wait(reviewer *reviewer);
+
+// "?!", "?" or "??", empty for good moves
+const char *review_grade_suffix(review_grade grade);
+
+// Expected score, 0 to 1, of the side a centipawn score is for. Moves are graded by it, and the GUI's evaluation bar
+// uses it too so both show the same thing
+double review_expected_score(int score);
+
+// Centipawns as pawns with a sign ("+1.25", "-0.40"), mates as moves to mate ("#3", "-#2")
+void review_format_score(int score, char *text, size_t size);
+
+#endif
@@ -0,0 +1,782 @@
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "util.h"
+
+#define TT_EXACT 1
+#define TT_LOWER 2 // Score is at least the stored one (fail high)
+#define TT_UPPER 3 // Score is at most the stored one (fail low)
+#define TIME_CHECK_INTERVAL 1024
+#define MATE_BOUND (SEARCH_MATE - SEARCH_MAX_PLY)
+#define ASPIRATION_WINDOW 25 // Half width around a multi-PV line's score from the last iteration, doubled on every fail
+
+typedef struct
+{
+    uint64_t key;
+    uint16_t move; // from | to << 6 | promotion << 12, see pack_move. Not gamedb's packing, the promotion codes differ
+    int16_t score;
+    int8_t depth;
+    uint8_t bound;
+    uint8_t padding[2];
+} tt_entry;
+
+struct search_context
+{
+    tt_entry *tt;
+    uint64_t tt_mask;
+
+    const search_limits *limits;
+    uint64_t nodes;
+    double start_time;
+    double hard_time; // Seconds after start_time, 0 without a time limit
+    bool stopped;
+    bool can_stop; // The first iteration always completes, so there is always a move to play
+    int seldepth;
+
+    move moves[SEARCH_MAX_PLY + 1][MAX_POSITION_MOVES];
+    int move_scores[SEARCH_MAX_PLY + 1][MAX_POSITION_MOVES];
+    move killers[SEARCH_MAX_PLY + 1][2];
+    int history[13][64];
+    move pv[SEARCH_MAX_PLY + 1][SEARCH_MAX_PLY + 1];
+    uint pv_length[SEARCH_MAX_PLY + 1];
+
+    move excluded[SEARCH_MAX_PV]; // Root moves of the lines already found in this iteration
+    uint excluded_count;
+};
+
+static int search_node(search_context *ctx, game *game, int depth, int ply, int alpha, int beta);
+static int quiescence(search_context *ctx, game *game, int ply, int alpha, int beta);
+static bool should_stop(search_context *ctx);
+static void score_moves(search_context *ctx, int ply, uint count, uint16_t tt_move);
+static move pick_move(search_context *ctx, int ply, uint index, uint count);
+static bool is_excluded(search_context *ctx, move m);
+static void sort_lines(search_line *lines, uint count);
+static bool is_capture(move m);
+static bool same_move(move a, move b);
+static uint16_t pack_move(move m);
+static int score_to_tt(int score, int ply);
+static int score_from_tt(int score, int ply);
+
+// Material and piece-square tables, the tables are from white's view with rank 8 first, like the board
+static const int piece_values[6] = {100, 500, 320, 330, 900, 0}; // Pawn, rook, knight, bishop, queen, king
+static const int phase_weights[6] = {0, 2, 1, 1, 4, 0};
+
+static const int piece_square_tables[6][64] = {
+    // Pawn
+    {0, 0, 0, 0, 0, 0, 0, 0,
+     50, 50, 50, 50, 50, 50, 50, 50,
+     10, 10, 20, 30, 30, 20, 10, 10,
+     5, 5, 10, 25, 25, 10, 5, 5,
+     0, 0, 0, 20, 20, 0, 0, 0,
+     5, -5, -10, 0, 0, -10, -5, 5,
+     5, 10, 10, -20, -20, 10, 10, 5,
+     0, 0, 0, 0, 0, 0, 0, 0},
+    // Rook
+    {0, 0, 0, 0, 0, 0, 0, 0,
+     5, 10, 10, 10, 10, 10, 10, 5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     0, 0, 0, 5, 5, 0, 0, 0},
+    // Knight
+    {-50, -40, -30, -30, -30, -30, -40, -50,
+     -40, -20, 0, 0, 0, 0, -20, -40,
+     -30, 0, 10, 15, 15, 10, 0, -30,
+     -30, 5, 15, 20, 20, 15, 5, -30,
+     -30, 0, 15, 20, 20, 15, 0, -30,
+     -30, 5, 10, 15, 15, 10, 5, -30,
+     -40, -20, 0, 5, 5, 0, -20, -40,
+     -50, -40, -30, -30, -30, -30, -40, -50},
+    // Bishop
+    {-20, -10, -10, -10, -10, -10, -10, -20,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -10, 0, 5, 10, 10, 5, 0, -10,
+     -10, 5, 5, 10, 10, 5, 5, -10,
+     -10, 0, 10, 10, 10, 10, 0, -10,
+     -10, 10, 10, 10, 10, 10, 10, -10,
+     -10, 5, 0, 0, 0, 0, 5, -10,
+     -20, -10, -10, -10, -10, -10, -10, -20},
+    // Queen
+    {-20, -10, -10, -5, -5, -10, -10, -20,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -10, 0, 5, 5, 5, 5, 0, -10,
+     -5, 0, 5, 5, 5, 5, 0, -5,
+     0, 0, 5, 5, 5, 5, 0, -5,
+     -10, 5, 5, 5, 5, 5, 0, -10,
+     -10, 0, 5, 0, 0, 0, 0, -10,
+     -20, -10, -10, -5, -5, -10, -10, -20},
+    // King, middlegame
+    {-30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -20, -30, -30, -40, -40, -30, -30, -20,
+     -10, -20, -20, -20, -20, -20, -20, -10,
+     20, 20, 0, 0, 0, 0, 20, 20,
+     20, 30, 10, 0, 0, 10, 30, 20}};
+
+// Blended in as material comes off the board
+static const int king_endgame_table[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10, 0, 0, -10, -20, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -30, 0, 0, 0, 0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50};
+
+search_context *search_create(size_t hash_megabytes)
+{
+    search_context *ctx = calloc(1, sizeof(search_context));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+
+    if (!search_set_hash(ctx, hash_megabytes))
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void search_destroy(search_context *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    free(ctx->tt);
+    free(ctx);
+}
+
+bool search_set_hash(search_context *ctx, size_t hash_megabytes)
+{
+    // Largest power of two number of entries that fits, at least one
+    uint64_t entries = 1;
+    while (entries * 2 * sizeof(tt_entry) <= hash_megabytes * 1024 * 1024)
+    {
+        entries *= 2;
+    }
+
+    tt_entry *tt = calloc(entries, sizeof(tt_entry));
+    if (tt == NULL)
+    {
+        return false;
+    }
+
+    free(ctx->tt);
+    ctx->tt = tt;
+    ctx->tt_mask = entries - 1;
+    return true;
+}
+
+void search_new_game(search_context *ctx)
+{
+    memset(ctx->tt, 0, (ctx->tt_mask + 1) * sizeof(tt_entry));
+    memset(ctx->killers, 0, sizeof(ctx->killers));
+    memset(ctx->history, 0, sizeof(ctx->history));
+}
+
+int search_hashfull(const search_context *ctx)
+{
+    uint64_t sample = (ctx->tt_mask + 1 < 1000) ? ctx->tt_mask + 1 : 1000;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < sample; i++)
+    {
+        used += ctx->tt[i].bound != 0;
+    }
+    return (int)(used * 1000 / sample);
+}
+
+search_result search_run(search_context *ctx, game *game, const search_limits *limits, search_callback on_iteration, void *user_data)
+{
+    search_result result = {0};
+
+    ctx->limits = limits;
+    ctx->nodes = 0;
+    ctx->start_time = now_seconds();
+    ctx->stopped = false;
+    ctx->can_stop = false;
+    ctx->hard_time = 0;
+
+    // Time per move: an even share of the clock plus most of the increment. The next iteration isn't started after
+    // half of it, since it would most likely not finish anyway
+    double soft_time = 0;
+    if (limits->move_time > 0)
+    {
+        ctx->hard_time = limits->move_time;
+    }
+    else if (limits->time_left > 0)
+    {
+        int moves_to_go = (limits->moves_to_go > 0) ? limits->moves_to_go : 30;
+        soft_time = limits->time_left / moves_to_go + limits->increment * 0.75;
+        ctx->hard_time = soft_time * 3;
+        if (ctx->hard_time > limits->time_left * 0.5)
+        {
+            ctx->hard_time = limits->time_left * 0.5;
+        }
+        if (soft_time > ctx->hard_time)
+        {
+            soft_time = ctx->hard_time;
+        }
+    }
+
+    // Decay the history so old searches don't dominate move ordering
+    for (int p = 0; p < 13; p++)
+    {
+        for (int sq = 0; sq < 64; sq++)
+        {
+            ctx->history[p][sq] /= 8;
+        }
+    }
+
+    int max_depth = (limits->depth > 0 && limits->depth < SEARCH_MAX_PLY) ? limits->depth : SEARCH_MAX_PLY - 1;
+
+    // No more lines than legal moves, a position without any still gets one empty line
+    move root_moves[MAX_POSITION_MOVES];
+    uint line_count = (limits->multi_pv > 1) ? (uint)limits->multi_pv : 1;
+    uint legal_count = generate_legal_moves(game, root_moves);
+    line_count = (line_count > SEARCH_MAX_PV) ? SEARCH_MAX_PV : line_count;
+    if (legal_count == 0)
+    {
+        line_count = 1;
+    }
+    else if (line_count > legal_count)
+    {
+        line_count = legal_count;
+    }
+
+    search_line lines[SEARCH_MAX_PV];
+
+    for (int depth = 1; depth <= max_depth; depth++)
+    {
+        ctx->seldepth = 0;
+        ctx->excluded_count = 0;
+
+        for (uint i = 0; i < line_count && !ctx->stopped; i++)
+        {
+            // Later lines mostly score close to where they did one iteration ago, a narrow window around that cuts
+            // most of their tree. The best line keeps the full window, so single-line searches are unchanged
+            int delta = ASPIRATION_WINDOW;
+            bool aspirate = i > 0 && depth > 1 && abs(lines[i].score) < MATE_BOUND;
+            int alpha = aspirate ? lines[i].score - delta : -SEARCH_INFINITE;
+            int beta = aspirate ? lines[i].score + delta : SEARCH_INFINITE;
+            while (true)
+            {
+                int score = search_node(ctx, game, depth, 0, alpha, beta);
+                lines[i].score = score;
+                if (ctx->stopped || (score > alpha && score < beta))
+                {
+                    break;
+                }
+
+                // Widen the side that failed, the bound is only a bound until it's searched again
+                delta *= 2;
+                if (score <= alpha)
+                {
+                    alpha = (score - delta > -SEARCH_INFINITE) ? score - delta : -SEARCH_INFINITE;
+                }
+                else
+                {
+                    beta = (score + delta < SEARCH_INFINITE) ? score + delta : SEARCH_INFINITE;
+                }
+            }
+            lines[i].pv_length = ctx->pv_length[0];
+            memcpy(lines[i].pv, ctx->pv[0], sizeof(move) * lines[i].pv_length);
+            if (lines[i].pv_length > 0)
+            {
+                ctx->excluded[ctx->excluded_count++] = lines[i].pv[0];
+            }
+        }
+
+        // An iteration only counts once all its lines are complete
+        if (ctx->stopped)
+        {
+            break;
+        }
+
+        // Later lines can come out better than earlier ones, a line is only searched against the moves before it
+        sort_lines(lines, line_count);
+
+        result.score = lines[0].score;
+        result.depth = depth;
+        result.seldepth = ctx->seldepth;
+        memcpy(result.lines, lines, sizeof(search_line) * line_count);
+        result.line_count = line_count;
+        result.best_move = (lines[0].pv_length > 0) ? lines[0].pv[0] : (move){0};
+        result.nodes = ctx->nodes;
+        result.time = now_seconds() - ctx->start_time;
+        ctx->can_stop = true;
+
+        if (on_iteration != NULL)
+        {
+            on_iteration(&result, user_data);
+        }
+
+        // No legal moves or every line ends in a forced mate, deeper iterations won't change anything
+        bool all_mates = true;
+        for (uint i = 0; i < line_count; i++)
+        {
+            all_mates = all_mates && abs(lines[i].score) >= MATE_BOUND;
+        }
+        if (lines[0].pv_length == 0 || all_mates)
+        {
+            break;
+        }
+
+        if ((soft_time > 0 && result.time > soft_time * 0.5) || should_stop(ctx))
+        {
+            break;
+        }
+    }
+
+    result.nodes = ctx->nodes;
+    result.time = now_seconds() - ctx->start_time;
+    return result;
+}
+
+int evaluate(game *game)
+{
+    int middlegame = 0, endgame = 0, phase = 0;
+    int bishops[2] = {0, 0};
+
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            piece_type piece = game->board[y][x];
+            if (piece == EMPTY)
+            {
+                continue;
+            }
+
+            int kind = (piece - 1) % 6;
+            piece_color color = get_piece_color(piece);
+            int square = (color == CChessWhite) ? y * 8 + x : (7 - y) * 8 + x; // Black reads the tables mirrored
+            int sign = (color == CChessWhite) ? 1 : -1;
+
+            int value = piece_values[kind];
+            if (kind == 5)
+            {
+                middlegame += sign * piece_square_tables[kind][square];
+                endgame += sign * king_endgame_table[square];
+            }
+            else
+            {
+                middlegame += sign * (value + piece_square_tables[kind][square]);
+                endgame += sign * (value + piece_square_tables[kind][square]);
+            }
+
+            phase += phase_weights[kind];
+            bishops[color] += kind == 3;
+        }
+    }
+
+    if (phase > 24)
+    {
+        phase = 24;
+    }
+
+    int score = (middlegame * phase + endgame * (24 - phase)) / 24;
+    score += (bishops[CChessWhite] >= 2) ? 30 : 0;
+    score -= (bishops[CChessBlack] >= 2) ? 30 : 0;
+
+    return (game->current_turn == CChessWhite) ? score : -score;
+}
+
+static int search_node(search_context *ctx, game *game, int depth, int ply, int alpha, int beta)
+{
+    ctx->pv_length[ply] = 0;
+
+    if (ply > 0)
+    {
+        // Any repetition is scored as a draw, repeating once more can't be better for the side that could avoid it
+        if (game->halfmove_clock >= 100 || repetition_count(game) > 0)
+        {
+            return 0;
+        }
+
+        // Mate distance pruning, a mate further away than one already found can't improve anything
+        if (alpha < -SEARCH_MATE + ply)
+        {
+            alpha = -SEARCH_MATE + ply;
+        }
+        if (beta > SEARCH_MATE - ply - 1)
+        {
+            beta = SEARCH_MATE - ply - 1;
+        }
+        if (alpha >= beta)
+        {
+            return alpha;
+        }
+    }
+
+    bool in_check = is_in_check(game, game->current_turn);
+    if (in_check && ply < SEARCH_MAX_PLY / 2)
+    {
+        depth++;
+    }
+
+    if (depth <= 0 || ply >= SEARCH_MAX_PLY)
+    {
+        return quiescence(ctx, game, ply, alpha, beta);
+    }
+
+    ctx->nodes++;
+    if (should_stop(ctx))
+    {
+        return 0;
+    }
+
+    bool pv_node = beta - alpha > 1;
+    tt_entry *entry = &ctx->tt[game->hash & ctx->tt_mask];
+    uint16_t tt_move = 0;
+    if (entry->key == game->hash)
+    {
+        tt_move = entry->move;
+        int tt_score = score_from_tt(entry->score, ply);
+
+        if (!pv_node && ply > 0 && entry->depth >= depth &&
+            (entry->bound == TT_EXACT || (entry->bound == TT_LOWER && tt_score >= beta) ||
+             (entry->bound == TT_UPPER && tt_score <= alpha)))
+        {
+            return tt_score;
+        }
+    }
+
+    uint count = generate_legal_moves(game, ctx->moves[ply]);
+    if (count == 0)
+    {
+        return in_check ? -SEARCH_MATE + ply : 0;
+    }
+
+    score_moves(ctx, ply, count, tt_move);
+
+    int original_alpha = alpha;
+    int best_score = -SEARCH_INFINITE;
+    move best_move = ctx->moves[ply][0];
+
+    uint searched = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        move m = pick_move(ctx, ply, i, count);
+        if (ply == 0 && is_excluded(ctx, m))
+        {
+            continue;
+        }
+        bool quiet = !is_capture(m) && m.promotion_piece == EMPTY;
+
+        make_move(game, m);
+
+        int score;
+        if (searched++ == 0)
+        {
+            score = -search_node(ctx, game, depth - 1, ply + 1, -beta, -alpha);
+        }
+        else
+        {
+            // Late quiet moves are searched shallower first and only get the full depth if they look good
+            int reduction = 0;
+            if (depth >= 3 && searched > 3 && quiet && !in_check && !is_in_check(game, game->current_turn))
+            {
+                reduction = (searched > 8 && depth >= 5) ? 2 : 1;
+            }
+
+            score = -search_node(ctx, game, depth - 1 - reduction, ply + 1, -alpha - 1, -alpha);
+            if (score > alpha && reduction > 0)
+            {
+                score = -search_node(ctx, game, depth - 1, ply + 1, -alpha - 1, -alpha);
+            }
+            if (score > alpha && score < beta)
+            {
+                score = -search_node(ctx, game, depth - 1, ply + 1, -beta, -alpha);
+            }
+        }
+
+        undo_last_move(game);
+
+        if (ctx->stopped)
+        {
+            return 0;
+        }
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_move = m;
+
+            if (score > alpha)
+            {
+                alpha = score;
+
+                ctx->pv[ply][0] = m;
+                memcpy(&ctx->pv[ply][1], ctx->pv[ply + 1], sizeof(move) * ctx->pv_length[ply + 1]);
+                ctx->pv_length[ply] = ctx->pv_length[ply + 1] + 1;
+
+                if (alpha >= beta)
+                {
+                    if (quiet)
+                    {
+                        if (!same_move(ctx->killers[ply][0], m))
+                        {
+                            ctx->killers[ply][1] = ctx->killers[ply][0];
+                            ctx->killers[ply][0] = m;
+                        }
+                        ctx->history[m.origin_piece][m.y_to * 8 + m.x_to] += depth * depth;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    // Keep the deeper result, but always let a new position take the slot. A root searched without some of its moves
+    // has no true score to store
+    bool partial_root = ply == 0 && ctx->excluded_count > 0;
+    if (!partial_root && (entry->key != game->hash || depth >= entry->depth))
+    {
+        entry->key = game->hash;
+        entry->move = pack_move(best_move);
+        entry->score = score_to_tt(best_score, ply);
+        entry->depth = depth;
+        entry->bound = (best_score >= beta) ? TT_LOWER : (best_score > original_alpha) ? TT_EXACT : TT_UPPER;
+    }
+
+    return best_score;
+}
+
+static int quiescence(search_context *ctx, game *game, int ply, int alpha, int beta)
+{
+    ctx->pv_length[ply] = 0;
+    ctx->nodes++;
+    if (ply > ctx->seldepth)
+    {
+        ctx->seldepth = ply;
+    }
+
+    if (should_stop(ctx))
+    {
+        return 0;
+    }
+
+    int stand_pat = evaluate(game);
+    if (ply >= SEARCH_MAX_PLY || stand_pat >= beta)
+    {
+        return stand_pat;
+    }
+    if (stand_pat > alpha)
+    {
+        alpha = stand_pat;
+    }
+
+    // Only captures and promotions, everything else is assumed to be no better than standing pat
+    uint all = generate_legal_moves(game, ctx->moves[ply]);
+    uint count = 0;
+    for (uint i = 0; i < all; i++)
+    {
+        if (is_capture(ctx->moves[ply][i]) || ctx->moves[ply][i].promotion_piece != EMPTY)
+        {
+            ctx->moves[ply][count++] = ctx->moves[ply][i];
+        }
+    }
+
+    score_moves(ctx, ply, count, 0);
+
+    for (uint i = 0; i < count; i++)
+    {
+        move m = pick_move(ctx, ply, i, count);
+
+        make_move(game, m);
+        int score = -quiescence(ctx, game, ply + 1, -beta, -alpha);
+        undo_last_move(game);
+
+        if (ctx->stopped)
+        {
+            return 0;
+        }
+
+        if (score > alpha)
+        {
+            alpha = score;
+            if (alpha >= beta)
+            {
+                break;
+            }
+        }
+    }
+
+    return alpha;
+}
+
+static bool should_stop(search_context *ctx)
+{
+    if (ctx->stopped)
+    {
+        return true;
+    }
+
+    if (!ctx->can_stop)
+    {
+        return false;
+    }
+
+    // The node limit is checked exactly, so node limited searches are reproducible
+    const search_limits *limits = ctx->limits;
+    if (limits->nodes > 0 && ctx->nodes >= limits->nodes)
+    {
+        ctx->stopped = true;
+    }
+    else if (ctx->nodes % TIME_CHECK_INTERVAL == 0)
+    {
+        if ((limits->stop != NULL && atomic_load_explicit(limits->stop, memory_order_relaxed)) ||
+            (ctx->hard_time > 0 && now_seconds() - ctx->start_time >= ctx->hard_time))
+        {
+            ctx->stopped = true;
+        }
+    }
+
+    return ctx->stopped;
+}
+
+// Hash move first, then captures by most valuable victim and least valuable attacker, killers, and quiet moves by history
+static void score_moves(search_context *ctx, int ply, uint count, uint16_t tt_move)
+{
+    for (uint i = 0; i < count; i++)
+    {
+        move m = ctx->moves[ply][i];
+        int score;
+
+        if (tt_move != 0 && pack_move(m) == tt_move)
+        {
+            score = 1000000;
+        }
+        else if (is_capture(m) || m.promotion_piece != EMPTY)
+        {
+            int victim = (m.destination_piece != EMPTY) ? piece_values[(m.destination_piece - 1) % 6] : piece_values[0];
+            int promotion = (m.promotion_piece != EMPTY) ? piece_values[(m.promotion_piece - 1) % 6] : 0;
+            score = 100000 + 10 * (victim + promotion) - piece_values[(m.origin_piece - 1) % 6] / 10;
+        }
+        else if (same_move(ctx->killers[ply][0], m))
+        {
+            score = 90000;
+        }
+        else if (same_move(ctx->killers[ply][1], m))
+        {
+            score = 80000;
+        }
+        else
+        {
+            score = ctx->history[m.origin_piece][m.y_to * 8 + m.x_to];
+            if (score > 70000)
+            {
+                score = 70000;
+            }
+        }
+
+        ctx->move_scores[ply][i] = score;
+    }
+}
+
+// Selection sort step, moves after a cutoff are never sorted
+static move pick_move(search_context *ctx, int ply, uint index, uint count)
+{
+    uint best = index;
+    for (uint i = index + 1; i < count; i++)
+    {
+        if (ctx->move_scores[ply][i] > ctx->move_scores[ply][best])
+        {
+            best = i;
+        }
+    }
+
+    move m = ctx->moves[ply][best];
+    int score = ctx->move_scores[ply][best];
+    ctx->moves[ply][best] = ctx->moves[ply][index];
+    ctx->move_scores[ply][best] = ctx->move_scores[ply][index];
+    ctx->moves[ply][index] = m;
+    ctx->move_scores[ply][index] = score;
+    return m;
+}
+
+static bool is_excluded(search_context *ctx, move m)
+{
+    for (uint i = 0; i < ctx->excluded_count; i++)
+    {
+        if (same_move(ctx->excluded[i], m))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Insertion sort by score, best first. Equal scores keep their order
+static void sort_lines(search_line *lines, uint count)
+{
+    for (uint i = 1; i < count; i++)
+    {
+        search_line line = lines[i];
+        uint j = i;
+        while (j > 0 && lines[j - 1].score < line.score)
+        {
+            lines[j] = lines[j - 1];
+            j--;
+        }
+        lines[j] = line;
+    }
+}
+
+static bool is_capture(move m)
+{
+    // A pawn moving diagonally onto an empty square is an en passant capture
+    bool pawn = m.origin_piece == WhitePawn || m.origin_piece == BlackPawn;
+    return m.destination_piece != EMPTY || (pawn && m.x_from != m.x_to);
+}
+
+static bool same_move(move a, move b)
+{
+    return a.x_from == b.x_from && a.y_from == b.y_from && a.x_to == b.x_to && a.y_to == b.y_to &&
+           a.promotion_piece == b.promotion_piece && a.origin_piece == b.origin_piece;
+}
+
+// Promotion is the piece type of either color folded to 1-5 (rook 2, knight 3, bishop 4, queen 5), only ever compared
+// with moves packed the same way
+static uint16_t pack_move(move m)
+{
+    uint promotion = (m.promotion_piece != EMPTY) ? (m.promotion_piece - 1) % 6 + 1 : 0;
+    return (uint16_t)((m.y_from * 8 + m.x_from) | ((m.y_to * 8 + m.x_to) << 6) | (promotion << 12));
+}
+
+// Mate scores are stored relative to the node, so they stay correct when the position is reached at another ply
+static int score_to_tt(int score, int ply)
+{
+    if (score >= MATE_BOUND)
+    {
+        return score + ply;
+    }
+    if (score <= -MATE_BOUND)
+    {
+        return score - ply;
+    }
+    return score;
+}
+
+static int score_from_tt(int score, int ply)
+{
+    if (score >= MATE_BOUND)
+    {
+        return score - ply;
+    }
+    if (score <= -MATE_BOUND)
+    {
+        return score + ply;
+    }
+    return score;
+}
@@ -0,0 +1,76 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "chess.h"
+
+#define SEARCH_MAX_PLY 64
+#define SEARCH_INFINITE 32000
+#define SEARCH_MATE 31000 // Mate in n plies scores SEARCH_MATE - n
+#define SEARCH_MAX_PV 8     // Most lines a multi-PV search reports
+
+typedef struct
+{
+    int depth;           // Last iteration to search, 0 for no limit
+    uint64_t nodes;      // 0 for no limit
+    double move_time;    // Seconds for this move, 0 for no limit
+    double time_left;    // Clock of the side to move in seconds, 0 when not playing on a clock
+    double increment;    // Seconds added per move
+    int moves_to_go;     // Moves until the clock is refilled, 0 if it has to last the whole game
+    int multi_pv;        // Best lines to find, up to SEARCH_MAX_PV. 0 or 1 for only the best move
+    atomic_bool *stop;   // Optional, the search returns soon after another thread sets it
+} search_limits;
+
+typedef struct
+{
+    int score; // Centipawns from the view of the side to move, mates are near +-SEARCH_MATE
+    move pv[SEARCH_MAX_PLY];
+    uint pv_length;
+} search_line;
+
+typedef struct
+{
+    move best_move; // From the last completed iteration, origin_piece is EMPTY if there is no legal move
+    int score;      // Of the best line
+    int depth;      // Last completed iteration
+    int seldepth;   // Deepest ply reached, including quiescence
+    uint64_t nodes;
+    double time; // Seconds
+    search_line lines[SEARCH_MAX_PV]; // Best first. Fewer than asked for if there aren't enough legal moves
+    uint line_count;
+} search_result;
+
+// Called after every completed iteration, e.g. to print UCI info lines
+typedef void (*search_callback)(const search_result *result, void *user_data);
+
+// Transposition table, move ordering tables and per-ply move buffers. Too big for the stack, and one context must only
+// be used by one search at a time
+typedef struct search_context search_context;
+
+search_context *search_create(size_t hash_megabytes);
+
+void search_destroy(search_context *ctx);
+
+// Reallocates the transposition table, which also clears it
+bool search_set_hash(search_context *ctx, size_t hash_megabytes);
+
+// Forgets everything learned from earlier searches
+void search_new_game(search_context *ctx);
+
+// Permille of the transposition table in use, sampled from its first entries like the UCI hashfull field.
+// Not safe while another thread is searching with the context
+int search_hashfull(const search_context *ctx);
+
+// Iterative deepening until one of the limits is hit, with no limits it only returns once limits->stop is set.
+// The game is restored before returning. At least the first iteration is always completed.
+// With multi_pv every iteration searches the root once per line, each time without the root moves of the lines found
+// before it. The searches share the transposition table and move ordering, and lines after the first start with an
+// aspiration window around their last score. Still, every extra line costs close to another search of the root:
+// at depth 8, 2 lines take about 2x the nodes of 1 and 4 lines about 3.5x
+search_result search_run(search_context *ctx, game *game, const search_limits *limits, search_callback on_iteration, void *user_data);
+
+// Static evaluation in centipawns from the view of the side to move
+int evaluate(game *game);
+
+#endif
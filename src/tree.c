@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optree.h"
+#include "util.h"
+
+// Builds and queries an opening tree:
+//   cchess-tree build [-t threads] [-p max ply] [-m min games] <games.ccdb|games.pgn|-> <out.cctree>
+//   cchess-tree query <tree.cctree> "<FEN>"
+
+#define DEFAULT_MAX_PLY 30
+
+static int build_tree(int argc, char **argv);
+static int query_tree(int argc, char **argv);
+static void print_stats(const char *label, const optree_node *node);
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "build") == 0)
+    {
+        return build_tree(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "query") == 0)
+    {
+        return query_tree(argc - 2, argv + 2);
+    }
+
+    fprintf(stderr, "Usage: %s build [-t threads] [-p max ply] [-m min games] <games.ccdb|games.pgn|-> <out.cctree>\n", argv[0]);
+    fprintf(stderr, "       %s query <tree.cctree> \"<FEN>\"\n", argv[0]);
+    return 1;
+}
+
+static int build_tree(int argc, char **argv)
+{
+    optree_options options = {.threads = cpu_count(), .max_ply = DEFAULT_MAX_PLY, .min_games = 1};
+    int arg = 0;
+
+    for (; arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg += 2)
+    {
+        if (strcmp(argv[arg], "-t") == 0)
+        {
+            options.threads = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-p") == 0)
+        {
+            options.max_ply = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "-m") == 0)
+        {
+            options.min_games = atoi(argv[arg + 1]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (argc - arg != 2)
+    {
+        fprintf(stderr, "build needs an input and an output file\n");
+        return 1;
+    }
+
+    const char *input = argv[arg];
+    const char *output = argv[arg + 1];
+    double start = now_seconds();
+    bool ok;
+
+    // Anything that isn't a game database is read as PGN
+    gamedb *db = (strcmp(input, "-") == 0) ? NULL : gamedb_open(input);
+    if (db != NULL)
+    {
+        ok = optree_build_from_db(db, output, &options);
+        gamedb_close(db);
+    }
+    else
+    {
+        pgn_reader *reader = (strcmp(input, "-") == 0) ? pgn_open_file(stdin) : pgn_open(input);
+        if (reader == NULL)
+        {
+            perror(input);
+            return 1;
+        }
+
+        ok = optree_build_from_pgn(reader, output, &options);
+        pgn_close(reader);
+    }
+
+    double elapsed = now_seconds() - start;
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to build %s\n", output);
+        return 1;
+    }
+
+    optree *tree = optree_open(output);
+    fprintf(stderr, "positions: %llu, threads: %d, time: %.3f s\n",
+            tree ? (unsigned long long)tree->node_count : 0ULL, options.threads, elapsed);
+    optree_close(tree);
+    return 0;
+}
+
+static int query_tree(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "query needs a tree file and a FEN\n");
+        return 1;
+    }
+
+    game *g = malloc(sizeof(game));
+    if (g == NULL || !import_FEN(g, argv[1]))
+    {
+        fprintf(stderr, "Invalid FEN '%s'\n", argv[1]);
+        free(g);
+        return 1;
+    }
+
+    optree *tree = optree_open(argv[0]);
+    if (tree == NULL)
+    {
+        fprintf(stderr, "%s: not an opening tree\n", argv[0]);
+        free(g);
+        return 1;
+    }
+
+    double start = now_seconds();
+    const optree_node *node = optree_find(tree, g->hash);
+    optree_child children[OPTREE_MAX_CHILDREN];
+    uint child_count = optree_children(tree, g, children, OPTREE_MAX_CHILDREN);
+    double elapsed = now_seconds() - start;
+
+    if (node == NULL)
+    {
+        printf("position not in tree\n");
+    }
+    else
+    {
+        print_stats("position", node);
+    }
+
+    for (uint i = 0; i < child_count; i++)
+    {
+        char san[16];
+        move_to_SAN(g, children[i].move, san);
+        print_stats(san, &children[i].stats);
+    }
+
+    fprintf(stderr, "lookup: %.1f us\n", elapsed * 1e6);
+
+    optree_close(tree);
+    free(g);
+    return 0;
+}
+
+static void print_stats(const char *label, const optree_node *node)
+{
+    double games = node->games > 0 ? node->games : 1;
+    printf("%-10s %8u games  +%5.1f%% =%5.1f%% -%5.1f%%\n", label, node->games,
+           100.0 * node->white_wins / games, 100.0 * node->draws / games, 100.0 * node->black_wins / games);
+}
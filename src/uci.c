@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "search.h"
+
+// UCI engine on top of the rules engine and search, for match runners and chess GUIs:
+//   cchess-uci
+//   cchess-uci bench [depth]   searches the 51 bench positions and prints the node count and speed
+
+#define MAX_COMMAND_LENGTH 16384
+#define DEFAULT_HASH_MB 16
+#define BENCH_DEPTH 7
+#define BENCH_POSITIONS 51 // The node signature depends on the set, so the count is checked against the list
+
+typedef struct
+{
+    game *position;
+    search_context *search;
+    search_limits limits;
+    int multi_pv;
+    atomic_bool stop;
+    pthread_t thread;
+    bool searching;
+} uci_engine;
+
+static void handle_position(uci_engine *engine, char *args);
+static bool run_bench(uci_engine *engine, int depth);
+static void handle_go(uci_engine *engine, char *args);
+static void stop_search(uci_engine *engine);
+static void *search_thread(void *arg);
+static void print_info(const search_result *result, void *user_data);
+static int format_score(int score, char *str_buffer);
+
+// Middlegames, endgames and positions with mates, promotions, castling and en passant, for the bench command
+static const char *bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
+    "4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
+    "r3qbrk/6p1/2b2pPp/p3pP1Q/PpPpP2P/3P1B2/2PB3K/R5R1 w - - 16 42",
+    "6k1/1R3p2/6p1/2Bp3p/3P2q1/P7/1P2rQ1K/5R2 b - - 4 44",
+    "8/8/1p2k1p1/3p3p/1p1P1P1P/1P2PK2/8/8 w - - 3 54",
+    "7r/2p3k1/1p1p1qp1/1P1Bp3/p1P2r1P/P7/4R3/Q4RK1 w - - 0 36",
+    "r1bq1rk1/pp2b1pp/n1pp1n2/3P1p2/2P1p3/2N1P2N/PP2BPPP/R1BQ1RK1 b - - 2 10",
+    "3r3k/2r4p/1p1b3q/p4P2/P2Pp3/1B2P3/3BQ1RP/6K1 w - - 3 87",
+    "2r4r/1p4k1/1Pnp4/3Qb1pq/8/4BpPp/5P2/2RR1BK1 w - - 0 42",
+    "4q1bk/6b1/7p/p1p4p/PNPpP2P/KN4P1/3Q4/4R3 b - - 0 37",
+    "2q3r1/1r2pk2/pp3pp1/2pP3p/P1Pb1BbP/1P4Q1/R3NPP1/4R1K1 w - - 2 34",
+    "1r2r2k/1b4q1/pp5p/2pPp1p1/P3Pn2/1P1B1Q1P/2R3P1/4BR1K b - - 1 37",
+    "r3kbbr/pp1n1p1P/3ppnp1/q5N1/1P1pP3/P1N1B3/2P1QP2/R3KB1R b KQq b3 0 17",
+    "8/6pk/2b1Rp2/3r4/1R1B2PP/P5K1/8/2r5 b - - 16 42",
+    "1r4k1/4ppb1/2n1b1qp/pB4p1/1n1BP1P1/7P/2PNQPK1/3RN3 w - - 8 29",
+    "8/p2B4/PkP5/4p1pK/4Pb1p/5P2/8/8 w - - 29 68",
+    "3r4/ppq1ppkp/4bnp1/2pN4/2P1P3/1P4P1/PQ3PBP/R4K2 b - - 2 20",
+    "5rr1/4n2k/4q2P/P1P2n2/3B1p2/4pP2/2N1P3/1RR1K2Q w - - 1 49",
+    "1r5k/2pq2p1/3p3p/p1pP4/4QP2/PP1R3P/6PK/8 w - - 1 51",
+    "q5k1/5ppp/1r3bn1/1B6/P1N2P2/BQ2P1P1/5K1P/8 b - - 2 34",
+    "r1b2k1r/5n2/p4q2/1ppn1Pp1/3pp1p1/NP2P3/P1PPBK2/1RQN2R1 w - - 0 22",
+    "r1bqk2r/pppp1ppp/5n2/4b3/4P3/P1N5/1PP2PPP/R1BQKB1R w KQkq - 0 5",
+    "r1bqr1k1/pp1p1ppp/2p5/8/3N1Q2/P2BB3/1PP2PPP/R3K2n b Q - 1 12",
+    "r1bq2k1/p4r1p/1pp2pp1/3p4/1P1B3Q/P2B1N2/2P3PP/4R1K1 b - - 2 19",
+    "r4qk1/6r1/1p4p1/2ppBbN1/1p5Q/P7/2P3PP/5RK1 w - - 2 25",
+    "r7/6k1/1p6/2pp1p2/7Q/8/p1P2K1P/8 w - - 0 32",
+    "r3k2r/ppp1pp1p/2nqb1pn/3p4/4P3/2PP4/PP1NBPPP/R2QK1NR w KQkq - 1 5",
+    "3r1rk1/1pp1pn1p/p1n1q1p1/3p4/Q3P3/2P5/PP1NBPPP/4RRK1 w - - 0 12",
+    "5rk1/1pp1pn1p/p3Brp1/8/1n6/5N2/PP3PPP/2R2RK1 w - - 2 20",
+    "8/1p2pk1p/p1p1r1p1/3n4/8/5R2/PP3PPP/4R1K1 b - - 3 27",
+    "8/4pk2/1p1r2p1/p1p4p/Pn5P/3R4/1P3PP1/4RK2 w - - 1 33",
+    "8/5k2/1pnrp1p1/p1p4p/P6P/4R1PK/1P3P2/4R3 b - - 1 38",
+    "8/8/1p1kp1p1/p1pr1n1p/P6P/1R4P1/1P3PK1/1R6 b - - 15 45",
+    "8/8/1p1k2p1/p1prp2p/P2n3P/6P1/1P1R1PK1/4R3 b - - 5 49",
+    "8/8/1p4p1/p1p2k1p/P2npP1P/4K1P1/1P6/3R4 w - - 6 54",
+    "8/8/1p4p1/p1p2k1p/P2n1P1P/4K1P1/1P6/6R1 b - - 6 59",
+    "8/5k2/1p4p1/p1pK3p/P2n1P1P/6P1/1P6/4R3 b - - 14 63",
+    "8/1R6/1p1K1kp1/p6p/P1p2P1P/6P1/1Pn5/8 w - - 0 67",
+    "1rb1rn1k/p3q1bp/2p3p1/2p1p3/2P1P2N/PN1RBP2/1PQ4P/1R4K1 b - - 0 20",
+    "6k1/1p2b1pp/p2pq3/3p4/3P4/3Q1N2/PP3PPP/6K1 w - - 0 1",
+    "5k2/8/8/8/8/8/8/4K1R1 w - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1",
+    "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+    "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+    "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+    "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+    "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+};
+
+_Static_assert(sizeof(bench_positions) / sizeof(bench_positions[0]) == BENCH_POSITIONS,
+               "bench_positions must hold exactly BENCH_POSITIONS entries");
+
+int main(int argc, char **argv)
+{
+    uci_engine engine = {0};
+    engine.position = malloc(sizeof(game));
+    engine.search = search_create(DEFAULT_HASH_MB);
+    if (engine.position == NULL || engine.search == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    reset_game(engine.position);
+
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+    {
+        bool ok = run_bench(&engine, (argc >= 3) ? atoi(argv[2]) : BENCH_DEPTH);
+        search_destroy(engine.search);
+        free(engine.position);
+        return ok ? 0 : 1;
+    }
+
+    char *line = malloc(MAX_COMMAND_LENGTH);
+    while (fgets(line, MAX_COMMAND_LENGTH, stdin) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *command = line;
+        while (*command == ' ' || *command == '\t')
+        {
+            command++;
+        }
+
+        char *args = command + strcspn(command, " \t");
+        if (*args != '\0')
+        {
+            *args++ = '\0';
+        }
+
+        if (strcmp(command, "uci") == 0)
+        {
+            printf("id name cchess\n");
+            printf("id author cchess contributors\n");
+            printf("option name Hash type spin default %d min 1 max 4096\n", DEFAULT_HASH_MB);
+            printf("option name MultiPV type spin default 1 min 1 max %d\n", SEARCH_MAX_PV);
+            printf("uciok\n");
+        }
+        else if (strcmp(command, "isready") == 0)
+        {
+            printf("readyok\n");
+        }
+        else if (strcmp(command, "setoption") == 0)
+        {
+            int megabytes, lines;
+            if (sscanf(args, "name Hash value %d", &megabytes) == 1 && megabytes > 0)
+            {
+                stop_search(&engine);
+                if (!search_set_hash(engine.search, megabytes))
+                {
+                    printf("info string could not allocate %d MB\n", megabytes);
+                }
+            }
+            else if (sscanf(args, "name MultiPV value %d", &lines) == 1)
+            {
+                engine.multi_pv = (lines < 1) ? 1 : (lines > SEARCH_MAX_PV) ? SEARCH_MAX_PV : lines;
+            }
+        }
+        else if (strcmp(command, "ucinewgame") == 0)
+        {
+            stop_search(&engine);
+            search_new_game(engine.search);
+        }
+        else if (strcmp(command, "position") == 0)
+        {
+            stop_search(&engine);
+            handle_position(&engine, args);
+        }
+        else if (strcmp(command, "go") == 0)
+        {
+            stop_search(&engine);
+            handle_go(&engine, args);
+        }
+        else if (strcmp(command, "stop") == 0)
+        {
+            stop_search(&engine);
+        }
+        else if (strcmp(command, "bench") == 0)
+        {
+            stop_search(&engine);
+            run_bench(&engine, (*args != '\0') ? atoi(args) : BENCH_DEPTH);
+            reset_game(engine.position);
+        }
+        else if (strcmp(command, "quit") == 0)
+        {
+            stop_search(&engine);
+            break;
+        }
+
+        fflush(stdout);
+    }
+
+    // At the end of piped input a limited search is allowed to finish, only an infinite one is stopped
+    const search_limits *limits = &engine.limits;
+    if (engine.searching && limits->depth == 0 && limits->nodes == 0 && limits->move_time == 0 && limits->time_left == 0)
+    {
+        stop_search(&engine);
+    }
+    else if (engine.searching)
+    {
+        pthread_join(engine.thread, NULL);
+    }
+
+    search_destroy(engine.search);
+    free(engine.position);
+    free(line);
+    return 0;
+}
+
+static void handle_position(uci_engine *engine, char *args)
+{
+    char *moves = strstr(args, "moves");
+    if (moves != NULL)
+    {
+        moves[-1] = '\0';
+        moves += strlen("moves");
+    }
+
+    if (strncmp(args, "startpos", 8) == 0)
+    {
+        reset_game(engine->position);
+    }
+    else if (strncmp(args, "fen ", 4) != 0 || !import_FEN(engine->position, args + 4))
+    {
+        printf("info string invalid position '%s'\n", args);
+        reset_game(engine->position);
+        return;
+    }
+
+    for (char *token = moves ? strtok(moves, " \t") : NULL; token != NULL; token = strtok(NULL, " \t"))
+    {
+        move m;
+        if (!move_from_UCI(engine->position, token, &m))
+        {
+            printf("info string illegal move '%s'\n", token);
+            return;
+        }
+        make_move(engine->position, m);
+    }
+}
+
+// Every position is searched from a cleared state on this thread, so the node total only changes when the search does
+// Fails without a summary if a position doesn't import, skipping it would silently change the signature
+static bool run_bench(uci_engine *engine, int depth)
+{
+    int count = BENCH_POSITIONS;
+    search_limits limits = {.depth = (depth > 0) ? depth : BENCH_DEPTH};
+    uint64_t total_nodes = 0;
+    double total_time = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!import_FEN(engine->position, bench_positions[i]))
+        {
+            fprintf(stderr, "Bench position %d is not a valid FEN: %s\n", i + 1, bench_positions[i]);
+            return false;
+        }
+
+        search_new_game(engine->search);
+        search_result result = search_run(engine->search, engine->position, &limits, NULL, NULL);
+        total_nodes += result.nodes;
+        total_time += result.time;
+
+        fprintf(stderr, "Position %d/%d: %llu nodes\n", i + 1, count, (unsigned long long)result.nodes);
+    }
+
+    printf("Positions       : %d\n", count);
+    printf("Depth           : %d\n", limits.depth);
+    printf("Total time (ms) : %llu\n", (unsigned long long)(total_time * 1000));
+    printf("Nodes searched  : %llu\n", (unsigned long long)total_nodes);
+    printf("Nodes/second    : %llu\n", (unsigned long long)(total_time > 0 ? total_nodes / total_time : 0));
+    return true;
+}
+
+static void handle_go(uci_engine *engine, char *args)
+{
+    search_limits limits = {0};
+    double clocks[2] = {0, 0}, increments[2] = {0, 0};
+
+    for (char *token = strtok(args, " \t"); token != NULL; token = strtok(NULL, " \t"))
+    {
+        // "infinite" and "ponder" take no value and need no handling, searching until "stop" is the default
+        if (strcmp(token, "infinite") == 0 || strcmp(token, "ponder") == 0)
+        {
+            continue;
+        }
+
+        char *value = strtok(NULL, " \t");
+        if (value == NULL)
+        {
+            break;
+        }
+
+        if (strcmp(token, "wtime") == 0)
+            clocks[CChessWhite] = atof(value) / 1000;
+        else if (strcmp(token, "btime") == 0)
+            clocks[CChessBlack] = atof(value) / 1000;
+        else if (strcmp(token, "winc") == 0)
+            increments[CChessWhite] = atof(value) / 1000;
+        else if (strcmp(token, "binc") == 0)
+            increments[CChessBlack] = atof(value) / 1000;
+        else if (strcmp(token, "movestogo") == 0)
+            limits.moves_to_go = atoi(value);
+        else if (strcmp(token, "depth") == 0)
+            limits.depth = atoi(value);
+        else if (strcmp(token, "nodes") == 0)
+            limits.nodes = strtoull(value, NULL, 10);
+        else if (strcmp(token, "movetime") == 0)
+            limits.move_time = atof(value) / 1000;
+    }
+
+    piece_color side = engine->position->current_turn;
+    limits.time_left = clocks[side];
+    limits.increment = increments[side];
+    limits.stop = &engine->stop;
+    limits.multi_pv = engine->multi_pv;
+
+    engine->limits = limits;
+    atomic_store(&engine->stop, false);
+    engine->searching = pthread_create(&engine->thread, NULL, search_thread, engine) == 0;
+}
+
+static void stop_search(uci_engine *engine)
+{
+    if (!engine->searching)
+    {
+        return;
+    }
+
+    atomic_store(&engine->stop, true);
+    pthread_join(engine->thread, NULL);
+    engine->searching = false;
+}
+
+static void *search_thread(void *arg)
+{
+    uci_engine *engine = arg;
+    search_result result = search_run(engine->search, engine->position, &engine->limits, print_info, NULL);
+
+    char best[8] = "0000";
+    if (result.best_move.origin_piece != EMPTY)
+    {
+        move_to_UCI(result.best_move, best);
+    }
+
+    printf("bestmove %s\n", best);
+    fflush(stdout);
+    return NULL;
+}
+
+// One line per PV, the multipv field is left out when there is only one
+static void print_info(const search_result *result, void *user_data)
+{
+    (void)user_data;
+
+    uint64_t milliseconds = (uint64_t)(result->time * 1000);
+    uint64_t nps = (result->time > 0) ? (uint64_t)(result->nodes / result->time) : 0;
+
+    for (uint l = 0; l < result->line_count; l++)
+    {
+        const search_line *pv = &result->lines[l];
+
+        // Built up first and written at once, the main thread may be answering isready at the same time
+        char line[160 + SEARCH_MAX_PLY * 6];
+        int length = sprintf(line, "info depth %d seldepth %d ", result->depth, result->seldepth);
+        if (result->line_count > 1)
+        {
+            length += sprintf(line + length, "multipv %u ", l + 1);
+        }
+        length += sprintf(line + length, "score ");
+        length += format_score(pv->score, line + length);
+        length += sprintf(line + length, " nodes %llu nps %llu time %llu pv", (unsigned long long)result->nodes,
+                          (unsigned long long)nps, (unsigned long long)milliseconds);
+
+        for (uint i = 0; i < pv->pv_length; i++)
+        {
+            line[length++] = ' ';
+            move_to_UCI(pv->pv[i], line + length);
+            length += strlen(line + length);
+        }
+
+        printf("%s\n", line);
+    }
+    fflush(stdout);
+}
+
+static int format_score(int score, char *str_buffer)
+{
+    if (score >= SEARCH_MATE - SEARCH_MAX_PLY)
+    {
+        return sprintf(str_buffer, "mate %d", (SEARCH_MATE - score + 1) / 2);
+    }
+    if (score <= -SEARCH_MATE + SEARCH_MAX_PLY)
+    {
+        // Mated at the root is "mate 0", there's no negative zero
+        int moves = (SEARCH_MATE + score) / 2;
+        return (moves == 0) ? sprintf(str_buffer, "mate 0") : sprintf(str_buffer, "mate -%d", moves);
+    }
+    return sprintf(str_buffer, "cp %d", score);
+}
@@ -0,0 +1,12 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+// Small platform helpers shared by the tools and the background threads
+
+// Monotonic clock in seconds, only differences between calls mean anything
+double now_seconds();
+
+// Online processors, at least 1
+int cpu_count();
+
+#endif